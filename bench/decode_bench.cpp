@@ -0,0 +1,94 @@
+// Compares stbi_load, with and without the runtime-dispatched AVX2 kernels,
+// against the multithreaded JpegDecoder on one image.
+//
+//   decode_bench [image.jpg] [iterations]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "image.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+template <typename Fn> static double time_ms(int iterations, Fn fn) {
+  auto start = Clock::now();
+  for (int i = 0; i < iterations; i++)
+    fn();
+  std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+  return elapsed.count() / iterations;
+}
+
+int main(int argc, char **argv) {
+  const char *path = argc > 1 ? argv[1] : "../src/textures/wall.jpg";
+  int iterations = argc > 2 ? std::atoi(argv[2]) : 20;
+
+  std::vector<unsigned char> file;
+  if (!read_file(path, file)) {
+    std::fprintf(stderr, "could not read %s\n", path);
+    return 1;
+  }
+
+  int w, h, c;
+  unsigned char *reference = stbi_load_from_memory(
+      file.data(), (int)file.size(), &w, &h, &c, 0);
+  if (!reference) {
+    std::fprintf(stderr, "stb could not decode %s: %s\n", path,
+                 stbi_failure_reason());
+    return 1;
+  }
+  const size_t bytes = (size_t)w * h * c;
+  std::printf("%s: %dx%dx%d, %zu bytes compressed\n", path, w, h, c,
+              file.size());
+
+  auto stb_ms = [&] {
+    return time_ms(iterations, [&] {
+      int x, y, n;
+      stbi_image_free(
+          stbi_load_from_memory(file.data(), (int)file.size(), &x, &y, &n, 0));
+    });
+  };
+
+  // baseline is stb with its compile-time SIMD only; everything after this
+  // uses whatever the CPU dispatch picks
+  stbi_set_jpeg_avx2(0);
+  double stb = stb_ms();
+  std::printf("%-12s %9.3f ms  %8.1f MP/s\n", "stb", stb,
+              (double)w * h / stb / 1000.0);
+  stbi_set_jpeg_avx2(1);
+  double dispatched = stb_ms();
+  std::printf("%-12s %9.3f ms  %8.1f MP/s  x%.2f\n", "stb+dispatch",
+              dispatched, (double)w * h / dispatched / 1000.0,
+              stb / dispatched);
+
+  unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned threads = 1;; threads = std::min(threads * 2, hw)) {
+    JpegDecoder decoder(threads, 0);
+    int x, y, n;
+    unsigned char *out =
+        decoder.decode(file.data(), file.size(), &x, &y, &n, 0);
+    if (!out) {
+      std::printf("not a baseline JPEG the threaded path handles\n");
+      break;
+    }
+    bool match = std::memcmp(out, reference, bytes) == 0;
+    stbi_image_free(out);
+
+    double ms = time_ms(iterations, [&] {
+      stbi_image_free(decoder.decode(file.data(), file.size(), &x, &y, &n, 0));
+    });
+    char label[32];
+    std::snprintf(label, sizeof(label), "threads=%u", threads);
+    std::printf("%-12s %9.3f ms  %8.1f MP/s  x%.2f%s\n", label, ms,
+                (double)w * h / ms / 1000.0, stb / ms,
+                match ? "" : "  OUTPUT MISMATCH");
+    if (threads == hw)
+      break;
+  }
+
+  stbi_image_free(reference);
+  return 0;
+}
@@ -0,0 +1,54 @@
+# Writes OUTPUT, a header holding each of FILES (absolute paths separated by
+# "|", since add_custom_command would split a list) as a constexpr byte array,
+# plus a table naming them by their path relative to ROOT. Run in script mode
+# from the add_custom_command in CMakeLists.txt.
+
+string(REPLACE "|" ";" FILES "${FILES}")
+
+# CMake regexes have no {n}, so spell out a row of 16 bytes
+set(row "")
+foreach(i RANGE 15)
+	string(APPEND row "0x..,")
+endforeach()
+
+set(arrays "")
+set(table "")
+set(index 0)
+foreach(file ${FILES})
+	file(RELATIVE_PATH name "${ROOT}" "${file}")
+	file(READ "${file}" hex HEX)
+	string(LENGTH "${hex}" digits)
+	math(EXPR size "${digits} / 2")
+	string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+	string(REGEX REPLACE "(${row})" "\\1\n\t" bytes "${bytes}")
+
+	# the extra 0 terminates text files without counting towards size
+	string(APPEND arrays "// ${name}\ninline constexpr unsigned char data${index}[] = {\n\t${bytes}0};\n\n")
+	string(APPEND table "\t{\"${name}\", data${index}, ${size}},\n")
+	math(EXPR index "${index} + 1")
+endforeach()
+
+file(WRITE "${OUTPUT}.tmp"
+"// Generated by cmake/embed_assets.cmake, do not edit.
+#pragma once
+
+#include <cstddef>
+
+namespace embedded {
+
+struct File {
+	const char *path;
+	const unsigned char *data;
+	size_t size;
+};
+
+${arrays}inline constexpr File files[] = {
+${table}};
+
+} // namespace embedded
+")
+
+# only touch the header when it changed, so unrelated edits don't rebuild
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different
+	"${OUTPUT}.tmp" "${OUTPUT}")
+file(REMOVE "${OUTPUT}.tmp")
@@ -37,7 +37,7 @@
 
       - decode from memory or through FILE (define STBI_NO_STDIO to remove code)
       - decode from arbitrary I/O callbacks
-      - SIMD acceleration on x86/x64 (SSE2) and ARM (NEON)
+      - SIMD acceleration on x86/x64 (SSE2, AVX2 at runtime) and ARM (NEON)
 
    Full documentation under "DOCUMENTATION" below.
 
@@ -524,6 +524,10 @@ STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpre
 STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+// allow the AVX2 JPEG kernels when the CPU has them (default on); only
+// meaningful on x86 GCC/Clang builds, mostly useful for benchmarking
+STBIDEF void stbi_set_jpeg_avx2(int flag_true_if_should_use);
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -774,6 +778,25 @@ static int stbi__sse2_available(void)
 #endif
 #endif
 
+// AVX2 kernels for the JPEG decoder. Unlike SSE2 these are not assumed: they
+// are compiled with a per-function target attribute and only selected at
+// runtime (stbi__setup_jpeg) when cpuid reports AVX2. GCC/Clang only; define
+// STBI_NO_AVX2 to leave them out.
+#if defined(STBI_SSE2) && !defined(STBI_NO_AVX2) && !defined(STBI_NO_JPEG) && !defined(_MSC_VER) && (defined(__GNUC__) || defined(__clang__))
+#define STBI_AVX2
+#include <immintrin.h>
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+
+// set from any thread while decoders run, hence the atomic accesses; a
+// decode already under way keeps the kernels it picked
+static int stbi__jpeg_avx2_allowed = 1;
+
+static int stbi__avx2_available(void)
+{
+   return __atomic_load_n(&stbi__jpeg_avx2_allowed, __ATOMIC_RELAXED) && __builtin_cpu_supports("avx2");
+}
+#endif
+
 // ARM NEON
 #if defined(STBI_NO_SIMD) && defined(STBI_NEON)
 #undef STBI_NEON
@@ -1107,6 +1130,15 @@ STBIDEF void stbi_image_free(void *retval_from_stbi_load)
 static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp);
 #endif
 
+STBIDEF void stbi_set_jpeg_avx2(int flag_true_if_should_use)
+{
+#ifdef STBI_AVX2
+   __atomic_store_n(&stbi__jpeg_avx2_allowed, flag_true_if_should_use, __ATOMIC_RELAXED);
+#else
+   STBI_NOTUSED(flag_true_if_should_use);
+#endif
+}
+
 #ifndef STBI_NO_HDR
 static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp);
 #endif
@@ -2704,6 +2736,177 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 
 #endif // STBI_SSE2
 
+#ifdef STBI_AVX2
+// AVX2 integer IDCT. Each 256-bit register carries two rows of the block,
+// paired so that one multiply-add does two of the SSE2 version's steps: the
+// (2,6) rotation with the widening of row0+row4 / row0-row4 in the even part,
+// and the (7,3) and (5,1) rotations in the odd part. It performs the same
+// integer operations as stbi__idct_simd, so the output is bit-identical to
+// it. Transposes and the final pack are the SSE2 ones on the 128-bit halves.
+STBI__AVX2_TARGET
+static void stbi__idct_avx2(stbi_uc *out, int out_stride, short data[64])
+{
+   __m128i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m128i tmp;
+
+   // low lane gets (x0,y0), high lane (x1,y1)
+   #define dct_const2(x0,y0,x1,y1) _mm256_setr_epi16((x0),(y0),(x0),(y0),(x0),(y0),(x0),(y0), \
+                                                     (x1),(y1),(x1),(y1),(x1),(y1),(x1),(y1))
+   #define dct_pair(hi,lo) _mm256_inserti128_si256(_mm256_castsi128_si256(lo), (hi), 1)
+   #define dct_swap(x) _mm256_permute2x128_si256((x), (x), 0x01)
+
+   // per lane: out(0) = c0[even]*x + c0[odd]*y, out(1) = c1[even]*x + c1[odd]*y
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##lo = _mm256_unpacklo_epi16((x),(y)); \
+      __m256i c0##hi = _mm256_unpackhi_epi16((x),(y)); \
+      __m256i out0##_l = _mm256_madd_epi16(c0##lo, c0); \
+      __m256i out0##_h = _mm256_madd_epi16(c0##hi, c0); \
+      __m256i out1##_l = _mm256_madd_epi16(c0##lo, c1); \
+      __m256i out1##_h = _mm256_madd_epi16(c0##hi, c1)
+
+   #define dct_wop(out, op, a, b) \
+      __m256i out##_l = op(a##_l, b##_l); \
+      __m256i out##_h = op(a##_h, b##_h)
+
+   #define dct_wswap(out, a) \
+      __m256i out##_l = dct_swap(a##_l); \
+      __m256i out##_h = dct_swap(a##_h)
+
+   // butterfly a/b, add bias, then shift by "s" and pack; each result holds
+   // two rows, low lane first
+   #define dct_bfly32o(sum_lo,sum_hi, dif_lo,dif_hi, a,b,bias,s) \
+      { \
+         __m256i abiased_l = _mm256_add_epi32(a##_l, bias); \
+         __m256i abiased_h = _mm256_add_epi32(a##_h, bias); \
+         dct_wop(sum, _mm256_add_epi32, abiased, b); \
+         dct_wop(dif, _mm256_sub_epi32, abiased, b); \
+         __m256i sum = _mm256_packs_epi32(_mm256_srai_epi32(sum_l, s), _mm256_srai_epi32(sum_h, s)); \
+         __m256i dif = _mm256_packs_epi32(_mm256_srai_epi32(dif_l, s), _mm256_srai_epi32(dif_h, s)); \
+         sum_lo = _mm256_castsi256_si128(sum); sum_hi = _mm256_extracti128_si256(sum, 1); \
+         dif_lo = _mm256_castsi256_si128(dif); dif_hi = _mm256_extracti128_si256(dif, 1); \
+      }
+
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi8(a, b); \
+      b = _mm_unpackhi_epi8(tmp, b)
+
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi16(a, b); \
+      b = _mm_unpackhi_epi16(tmp, b)
+
+   #define dct_pass(bias,shift) \
+      { \
+         __m256i r2s = dct_pair(_mm_add_epi16(row0, row4), row2); \
+         __m256i r6d = dct_pair(_mm_sub_epi16(row0, row4), row6); \
+         __m256i r75 = dct_pair(row5, row7); \
+         __m256i r31 = dct_pair(row1, row3); \
+         /* even part: [t2e|t0e], [t3e|t1e] */ \
+         dct_rot(te0,te1, r2s,r6d, rot_e0,rot_e1); \
+         dct_wswap(tes, te0); \
+         dct_wop(x01, _mm256_add_epi32, tes, te1); \
+         dct_wop(x3n2, _mm256_sub_epi32, tes, te1); \
+         __m256i x32_l = _mm256_sign_epi32(x3n2_l, lane_sign); \
+         __m256i x32_h = _mm256_sign_epi32(x3n2_h, lane_sign); \
+         /* odd part: [y0o|y1o], [y2o|y3o], then [y4o|y5o] */ \
+         dct_rot(yo0,yo1, r75,r31, rot_o0,rot_o1); \
+         __m256i s1735 = _mm256_add_epi16(r75, dct_swap(r31)); \
+         __m256i s17 = _mm256_permute2x128_si256(s1735, s1735, 0x00); \
+         __m256i s35 = _mm256_permute2x128_si256(s1735, s1735, 0x11); \
+         __m256i s45lo = _mm256_unpacklo_epi16(s17, s35); \
+         __m256i s45hi = _mm256_unpackhi_epi16(s17, s35); \
+         __m256i y45_l = _mm256_madd_epi16(s45lo, rot_1); \
+         __m256i y45_h = _mm256_madd_epi16(s45hi, rot_1); \
+         dct_wop(x45, _mm256_add_epi32, yo0, y45); \
+         dct_wswap(y54, y45); \
+         dct_wop(x67, _mm256_add_epi32, yo1, y54); \
+         dct_wswap(x76, x67); \
+         dct_bfly32o(row0,row1, row7,row6, x01,x76,bias,shift); \
+         dct_bfly32o(row3,row2, row4,row5, x32,x45,bias,shift); \
+      }
+
+   __m256i rot_e0 = dct_const2(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f), 4096, 0);
+   __m256i rot_e1 = dct_const2(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f), 0, 4096);
+   __m256i rot_1  = dct_const2(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f),
+                               stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+   __m256i rot_o0 = dct_const2(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f),
+                               stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+   __m256i rot_o1 = dct_const2(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f),
+                               stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+   __m256i lane_sign = _mm256_setr_epi32(1, 1, 1, 1, -1, -1, -1, -1);
+
+   // rounding biases in column/row passes, see stbi__idct_block for explanation.
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   // load
+   row0 = _mm_load_si128((const __m128i *) (data + 0*8));
+   row1 = _mm_load_si128((const __m128i *) (data + 1*8));
+   row2 = _mm_load_si128((const __m128i *) (data + 2*8));
+   row3 = _mm_load_si128((const __m128i *) (data + 3*8));
+   row4 = _mm_load_si128((const __m128i *) (data + 4*8));
+   row5 = _mm_load_si128((const __m128i *) (data + 5*8));
+   row6 = _mm_load_si128((const __m128i *) (data + 6*8));
+   row7 = _mm_load_si128((const __m128i *) (data + 7*8));
+
+   // column pass
+   dct_pass(bias_0, 10);
+
+   {
+      // 16bit 8x8 transpose
+      dct_interleave16(row0, row4);
+      dct_interleave16(row1, row5);
+      dct_interleave16(row2, row6);
+      dct_interleave16(row3, row7);
+      dct_interleave16(row0, row2);
+      dct_interleave16(row1, row3);
+      dct_interleave16(row4, row6);
+      dct_interleave16(row5, row7);
+      dct_interleave16(row0, row1);
+      dct_interleave16(row2, row3);
+      dct_interleave16(row4, row5);
+      dct_interleave16(row6, row7);
+   }
+
+   // row pass
+   dct_pass(bias_1, 17);
+
+   {
+      // pack, 8bit 8x8 transpose and store
+      __m128i p0 = _mm_packus_epi16(row0, row1);
+      __m128i p1 = _mm_packus_epi16(row2, row3);
+      __m128i p2 = _mm_packus_epi16(row4, row5);
+      __m128i p3 = _mm_packus_epi16(row6, row7);
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+      dct_interleave8(p0, p1);
+      dct_interleave8(p2, p3);
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+      _mm_storel_epi64((__m128i *) out, p0); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p0, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p2); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p2, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p1); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p1, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p3); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p3, 0x4e));
+   }
+
+#undef dct_const2
+#undef dct_pair
+#undef dct_swap
+#undef dct_rot
+#undef dct_wop
+#undef dct_wswap
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+}
+#endif // STBI_AVX2
+
 #ifdef STBI_NEON
 
 // NEON integer IDCT. should produce bit-identical
@@ -3643,6 +3846,67 @@ static stbi_uc *stbi__resample_row_hv_2_simd(stbi_uc *out, stbi_uc *in_near, stb
 }
 #endif
 
+#ifdef STBI_AVX2
+// stbi__resample_row_hv_2_simd 16 pixels at a time. The shifted "prev" and
+// "next" rows need to cross the 128-bit lanes, hence the permute+alignr.
+STBI__AVX2_TARGET
+static stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   int i=0,t0,t1;
+
+   if (w == 1) {
+      out[0] = out[1] = stbi__div4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   t1 = 3*in_near[0] + in_far[0];
+   for (; i < ((w-1) & ~15); i += 16) {
+      // vertical pass: 3*near + far = 4*near + (far - near)
+      __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i curr  = _mm256_add_epi16(_mm256_slli_epi16(nearw, 2), _mm256_sub_epi16(farw, nearw));
+
+      // curr shifted by one pixel either way, with the neighbours of the
+      // group filled in
+      __m256i lo0  = _mm256_permute2x128_si256(curr, curr, 0x08); // [0 | lo]
+      __m256i hi0  = _mm256_permute2x128_si256(curr, curr, 0x81); // [hi | 0]
+      __m256i prev = _mm256_insert_epi16(_mm256_alignr_epi8(curr, lo0, 14), (short) t1, 0);
+      __m256i next = _mm256_insert_epi16(_mm256_alignr_epi8(hi0, curr, 2), (short) (3*in_near[i+16] + in_far[i+16]), 15);
+
+      // horizontal pass, polyphase as in the SSE2 version
+      __m256i bias = _mm256_set1_epi16(8);
+      __m256i curs = _mm256_slli_epi16(curr, 2);
+      __m256i curb = _mm256_add_epi16(curs, bias);
+      __m256i even = _mm256_add_epi16(_mm256_sub_epi16(prev, curr), curb);
+      __m256i odd  = _mm256_add_epi16(_mm256_sub_epi16(next, curr), curb);
+
+      // interleave within each lane; the lanes already hold pixels 0-7 and
+      // 8-15 so packing puts everything back in order
+      __m256i int0 = _mm256_srli_epi16(_mm256_unpacklo_epi16(even, odd), 4);
+      __m256i int1 = _mm256_srli_epi16(_mm256_unpackhi_epi16(even, odd), 4);
+      _mm256_storeu_si256((__m256i *) (out + i*2), _mm256_packus_epi16(int0, int1));
+
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+
+   t0 = t1;
+   t1 = 3*in_near[i] + in_far[i];
+   out[i*2] = stbi__div16(3*t1 + t0 + 8);
+
+   for (++i; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = stbi__div16(3*t0 + t1 + 8);
+      out[i*2  ] = stbi__div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = stbi__div4(t1+2);
+
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+#endif
+
 static stbi_uc *stbi__resample_row_generic(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
 {
    // resample with nearest-neighbor
@@ -3817,6 +4081,90 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_AVX2
+// YCbCr to RGB(A) 16 pixels at a time, using the same reduced-precision math
+// as the SSE2 and scalar versions. Unlike SSE2 this also handles step == 3,
+// which is what 3 channel texture loads use.
+STBI__AVX2_TARGET
+static void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+
+   if (step == 3 || step == 4) {
+      __m128i signflip  = _mm_set1_epi8(-0x80);
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i y_bias = _mm256_set1_epi16(128);
+      __m128i alpha = _mm_set1_epi8((char) 255);
+      // rgba -> rgb for 4 pixels, top 4 bytes zeroed
+      __m128i drop_a = _mm_setr_epi8(0,1,2, 4,5,6, 8,9,10, 12,13,14, -1,-1,-1,-1);
+
+      for (; i+15 < count; i += 16) {
+         // load and widen; y becomes y*256+128, cr/cb (c-128)*256
+         __m128i y_bytes  = _mm_loadu_si128((__m128i *) (y+i));
+         __m128i cr_bytes = _mm_xor_si128(_mm_loadu_si128((__m128i *) (pcr+i)), signflip);
+         __m128i cb_bytes = _mm_xor_si128(_mm_loadu_si128((__m128i *) (pcb+i)), signflip);
+         __m256i yw  = _mm256_or_si256(_mm256_slli_epi16(_mm256_cvtepu8_epi16(y_bytes), 8), y_bias);
+         __m256i crw = _mm256_slli_epi16(_mm256_cvtepi8_epi16(cr_bytes), 8);
+         __m256i cbw = _mm256_slli_epi16(_mm256_cvtepi8_epi16(cb_bytes), 8);
+
+         // color transform
+         __m256i yws = _mm256_srli_epi16(yw, 4);
+         __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+         __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+         __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+         __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+         __m256i rws = _mm256_add_epi16(cr0, yws);
+         __m256i gwt = _mm256_add_epi16(cb0, yws);
+         __m256i bws = _mm256_add_epi16(yws, cb1);
+         __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+         // descale and back to bytes; packus works per lane, so pack the
+         // two halves of each channel against each other
+         __m256i rw = _mm256_srai_epi16(rws, 4);
+         __m256i gw = _mm256_srai_epi16(gws, 4);
+         __m256i bw = _mm256_srai_epi16(bws, 4);
+         __m128i r = _mm_packus_epi16(_mm256_castsi256_si128(rw), _mm256_extracti128_si256(rw, 1));
+         __m128i g = _mm_packus_epi16(_mm256_castsi256_si128(gw), _mm256_extracti128_si256(gw, 1));
+         __m128i b = _mm_packus_epi16(_mm256_castsi256_si128(bw), _mm256_extracti128_si256(bw, 1));
+
+         // interleave to rgba
+         __m128i rg0 = _mm_unpacklo_epi8(r, g);
+         __m128i rg1 = _mm_unpackhi_epi8(r, g);
+         __m128i ba0 = _mm_unpacklo_epi8(b, alpha);
+         __m128i ba1 = _mm_unpackhi_epi8(b, alpha);
+         __m128i o0 = _mm_unpacklo_epi16(rg0, ba0);
+         __m128i o1 = _mm_unpackhi_epi16(rg0, ba0);
+         __m128i o2 = _mm_unpacklo_epi16(rg1, ba1);
+         __m128i o3 = _mm_unpackhi_epi16(rg1, ba1);
+
+         if (step == 4) {
+            _mm_storeu_si128((__m128i *) (out + 0), o0);
+            _mm_storeu_si128((__m128i *) (out + 16), o1);
+            _mm_storeu_si128((__m128i *) (out + 32), o2);
+            _mm_storeu_si128((__m128i *) (out + 48), o3);
+            out += 64;
+         } else {
+            // squeeze each group of 4 pixels to 12 bytes and stitch them
+            // into exactly 48 bytes so nothing past the group is touched
+            __m128i p0 = _mm_shuffle_epi8(o0, drop_a);
+            __m128i p1 = _mm_shuffle_epi8(o1, drop_a);
+            __m128i p2 = _mm_shuffle_epi8(o2, drop_a);
+            __m128i p3 = _mm_shuffle_epi8(o3, drop_a);
+            _mm_storeu_si128((__m128i *) (out + 0),  _mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+            _mm_storeu_si128((__m128i *) (out + 16), _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8)));
+            _mm_storeu_si128((__m128i *) (out + 32), _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4)));
+            out += 48;
+         }
+      }
+   }
+
+   stbi__YCbCr_to_RGB_row(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
@@ -3832,6 +4180,14 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
    }
 #endif
 
+#ifdef STBI_AVX2
+   if (stbi__avx2_available()) {
+      j->idct_block_kernel = stbi__idct_avx2;
+      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+      j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+   }
+#endif
+
 #ifdef STBI_NEON
    j->idct_block_kernel = stbi__idct_simd;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
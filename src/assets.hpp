@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#ifdef EMBEDDED_ASSETS
+#include "embedded_assets.hpp"
+#endif
+
+// Shaders and textures, named by their path under src/, e.g.
+// "shaders/shader.vert". With EMBED_ASSETS on, CMake compiles them into the
+// executable (see cmake/embed_assets.cmake) and startup opens no files.
+// Setting ASSETS_DIR reads them from that directory instead, so edits show
+// up during development; the shader hot reload only watches in that mode.
+// Paths that are not embedded, or absolute, are read from disk.
+class Assets {
+public:
+  // directory assets are read from, empty when they are embedded
+  static const std::string &directory() {
+    static const std::string dir = [] {
+      if (const char *env = std::getenv("ASSETS_DIR"))
+        return std::string(env);
+#if defined(EMBEDDED_ASSETS)
+      return std::string();
+#elif defined(ASSETS_SOURCE_DIR)
+      return std::string(ASSETS_SOURCE_DIR);
+#else
+      return std::string(".");
+#endif
+    }();
+    return dir;
+  }
+
+  static bool fromDisk() { return !directory().empty(); }
+
+  static std::string diskPath(const std::string &path) {
+    if (directory().empty())
+      return path;
+    return (std::filesystem::path(directory()) / path).string();
+  }
+
+  // out is std::string or std::vector<unsigned char>
+  template <typename Buffer>
+  static bool read(const std::string &path, Buffer &out) {
+#ifdef EMBEDDED_ASSETS
+    if (!fromDisk())
+      for (const embedded::File &file : embedded::files)
+        if (path == file.path) {
+          out.assign(file.data, file.data + file.size);
+          return true;
+        }
+#endif
+    std::ifstream file(diskPath(path), std::ios::binary | std::ios::ate);
+    if (!file)
+      return false;
+    out.resize((size_t)file.tellg());
+    file.seekg(0);
+    return out.empty() || file.read((char *)&out[0], out.size());
+  }
+};
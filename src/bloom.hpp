@@ -0,0 +1,199 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "debug.hpp"
+#include "gpu_timer.hpp"
+#include "render_graph.hpp"
+#include "shader.hpp"
+#include "shader_library.hpp"
+
+// Glow around the bright parts of the scene, built on a mip pyramid:
+//   prefilter: half size, keeping only what is above the threshold
+//   down:      each further level half the size of the one before
+//   blur:      a separable Gaussian at every level (blur.glsl)
+//   up:        from the smallest level back up, each adds the one below
+//   composite: the top of that onto the scene
+// The kernels are fixed, so a wider glow takes more levels, each a quarter
+// the cost of the one before, rather than more taps. Every level's passes
+// are timed on the GPU, see levelMilliseconds().
+class Bloom {
+public:
+  int levels; // of the pyramid, including the half size one
+  float threshold = 0.8f;
+  float knee = 0.3f;
+  float spread = 0.8f; // how much the wider levels add, 0..1
+  float intensity = 0.6f;
+  bool enabled = true;
+
+  // vao is bound while drawing the fullscreen triangle
+  Bloom(ShaderLibrary &library, unsigned int vao, int levels = 5)
+      : levels(levels), vao(vao), down(MAX_LEVELS), up(MAX_LEVELS) {
+    Shader &base =
+        library.load("shaders/fullscreen.vert", "shaders/bloom.frag",
+                     [](Shader &s) {
+                       s.set(u_source, 0);
+                       s.set(u_detail, 1);
+                     });
+    prefilter = &library.variant(base, {"PREFILTER"});
+    downsample = &library.variant(base, {"DOWNSAMPLE"});
+    blur = &library.variant(base, {"BLUR"});
+    upsample = &library.variant(base, {"UPSAMPLE"});
+    composite = &library.variant(base, {"COMPOSITE"});
+  }
+
+  Bloom(const Bloom &) = delete;
+  Bloom &operator=(const Bloom &) = delete;
+
+  // Adds the passes to graph and returns the scene with the glow added, in
+  // a target described by desc. Returns scene itself while disabled or
+  // while the programs are still compiling.
+  RenderGraph::Resource addTo(RenderGraph &graph, RenderGraph::Resource scene,
+                              const RenderTargetDesc &desc) {
+    int count = std::min(std::max(levels, 1), MAX_LEVELS);
+    if (!enabled || !prefilter->ready() || !downsample->ready() ||
+        !blur->ready() || !upsample->ready() || !composite->ready())
+      return scene;
+
+    // d: downsampled, b: blurred, u: with the smaller levels added
+    std::vector<RenderGraph::Resource> d(count), b(count), u(count);
+    for (int i = 0; i < count; i++) {
+      RenderTargetDesc level = levelDesc(desc, i);
+      d[i] = graph.create("bloom down", level);
+      RenderGraph::Resource across = graph.create("bloom blur", level);
+      b[i] = graph.create("bloom blur", level);
+
+      RenderGraph::Resource from = i == 0 ? scene : d[i - 1];
+      Shader *reduce = i == 0 ? prefilter : downsample;
+      graph.addPass("bloom down").read(from).write(d[i]).execute(
+          [this, reduce, from, i](RenderGraph &g) {
+            down[i].begin();
+            draw(g, *reduce, from);
+          });
+      graph.addPass("bloom blur x").read(d[i]).write(across).execute(
+          [this, from = d[i]](RenderGraph &g) {
+            blur->use();
+            blur->set(u_blur_direction, glsl::vec2{1.0f, 0.0f});
+            draw(g, *blur, from);
+          });
+      graph.addPass("bloom blur y").read(across).write(b[i]).execute(
+          [this, across, i](RenderGraph &g) {
+            blur->use();
+            blur->set(u_blur_direction, glsl::vec2{0.0f, 1.0f});
+            draw(g, *blur, across);
+            down[i].end();
+          });
+    }
+
+    u[count - 1] = b[count - 1];
+    for (int i = count - 2; i >= 0; i--) {
+      u[i] = graph.create("bloom up", levelDesc(desc, i));
+      graph.addPass("bloom up")
+          .read(u[i + 1])
+          .read(b[i])
+          .write(u[i])
+          .execute([this, smaller = u[i + 1], same = b[i],
+                    i](RenderGraph &g) {
+            up[i].begin();
+            upsample->use();
+            upsample->set(u_spread, spread);
+            draw(g, *upsample, smaller, same);
+            up[i].end();
+          });
+    }
+
+    RenderGraph::Resource out = graph.create("bloom", desc);
+    graph.addPass("bloom composite")
+        .read(u[0])
+        .read(scene)
+        .write(out)
+        .execute([this, glow = u[0], scene](RenderGraph &g) {
+          compositeTimer.begin();
+          composite->use();
+          composite->set(u_intensity, intensity);
+          draw(g, *composite, glow, scene);
+          compositeTimer.end();
+        });
+
+    // set here rather than per pass, the prefilter is the only user
+    prefilter->use();
+    prefilter->set(u_threshold, threshold);
+    prefilter->set(u_knee, knee);
+    return out;
+  }
+
+  // GPU time of each level's passes, down and up, from the half size one
+  // down; negative until measured
+  std::vector<double> levelMilliseconds() const {
+    std::vector<double> ms;
+    for (int i = 0; i < std::min(levels, MAX_LEVELS); i++) {
+      double d = down[i].milliseconds(), u = up[i].milliseconds();
+      ms.push_back(d < 0 ? d : d + std::max(u, 0.0));
+    }
+    return ms;
+  }
+  double compositeMilliseconds() const {
+    return compositeTimer.milliseconds();
+  }
+
+  void logTimings() const {
+    std::vector<double> ms = levelMilliseconds();
+    double total = std::max(compositeMilliseconds(), 0.0);
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < ms.size(); i++) {
+      line << " 1/" << (2 << i) << ": " << ms[i] << ",";
+      total += std::max(ms[i], 0.0);
+    }
+    line << " composite " << compositeMilliseconds() << ", total " << total;
+    DBG("BLOOM::TIMING" << line.str() << " ms");
+  }
+
+private:
+  static constexpr int MAX_LEVELS = 8;
+
+  static inline const UniformId u_source{"source"}, u_detail{"detail"},
+      u_threshold{"threshold"}, u_knee{"knee"}, u_spread{"spread"},
+      u_intensity{"intensity"}, u_blur_direction{"blurDirection"};
+
+  unsigned int vao;
+  Shader *prefilter, *downsample, *blur, *upsample, *composite;
+  std::deque<GpuTimer> down, up; // per level
+  GpuTimer compositeTimer;
+
+  static RenderTargetDesc levelDesc(RenderTargetDesc desc, int level) {
+    float factor = std::ldexp(1.0f, -(level + 1));
+    desc.scale *= factor;
+    if (desc.width > 0)
+      desc.width = std::max(1, desc.width >> (level + 1));
+    if (desc.height > 0)
+      desc.height = std::max(1, desc.height >> (level + 1));
+    return desc;
+  }
+
+  // source on unit 0, detail on unit 1, into the pass's target
+  void draw(RenderGraph &g, Shader &shader, RenderGraph::Resource source,
+            RenderGraph::Resource detail = -1) {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, g.texture(source));
+    glBindSampler(0, 0);
+    if (detail >= 0) {
+      glActiveTexture(GL_TEXTURE1);
+      glBindTexture(GL_TEXTURE_2D, g.texture(detail));
+      glBindSampler(1, 0);
+      glActiveTexture(GL_TEXTURE0);
+    }
+    shader.use();
+    glBindVertexArray(vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+  }
+};
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Bump allocator that stb_image allocates from (see stb_impl.hpp). Each
+// thread decodes into its own arena, so bursts of loads neither fragment the
+// heap nor contend on malloc. A block is rewound as soon as everything handed
+// out from it has been freed again, so the scratch of one decode is reused by
+// the next even while earlier results are still alive. The arena also tracks
+// the high water mark of live bytes so callers can see what a decode needed.
+// Blocks above the minimum size are released once empty, outside a decode,
+// so one large image does not pin its peak for the life of the thread.
+// Allocations may outlive their thread: its blocks are then freed by
+// whichever thread frees their last allocation.
+class DecodeArena {
+public:
+  static DecodeArena &local() {
+    thread_local DecodeArena arena;
+    return arena;
+  }
+
+  DecodeArena() { self = this; }
+
+  // hands every block over to the allocations still in it, or frees it
+  ~DecodeArena() {
+    self = nullptr;
+    for (auto &b : blocks) {
+      b->owner.store(nullptr, std::memory_order_relaxed);
+      unref(b.release());
+    }
+  }
+
+  DecodeArena(const DecodeArena &) = delete;
+  DecodeArena &operator=(const DecodeArena &) = delete;
+
+  void *allocate(size_t size) {
+    size = (size + ALIGN - 1) & ~(ALIGN - 1);
+    const size_t need = sizeof(Header) + size;
+
+    if (!blocks.empty() && empty(current()))
+      offset = 0;
+    if (blocks.empty() || offset + need > current().size)
+      select(need);
+
+    Block &b = current();
+    Header *h = (Header *)(b.data.get() + offset);
+    h->size = size;
+    h->block = &b;
+    offset += need;
+    b.live.fetch_add(1, std::memory_order_relaxed);
+    b.used.fetch_add(need, std::memory_order_relaxed);
+    notePeak();
+    return h + 1;
+  }
+
+  void *reallocate(void *p, size_t size) {
+    if (!p)
+      return allocate(size);
+
+    Header *h = header(p);
+    size_t rounded = (size + ALIGN - 1) & ~(ALIGN - 1);
+    if (rounded <= h->size)
+      return p;
+
+    // the last allocation of the current block can grow in place, which is
+    // the common case for stb's zlib output buffer
+    if (h->block->owner.load(std::memory_order_relaxed) == this &&
+        isLast(h) && offset + rounded - h->size <= current().size) {
+      size_t extra = rounded - h->size;
+      offset += extra;
+      h->size = rounded;
+      current().used.fetch_add(extra, std::memory_order_relaxed);
+      notePeak();
+      return p;
+    }
+
+    void *q = allocate(size);
+    std::memcpy(q, p, h->size);
+    free(p);
+    return q;
+  }
+
+  // may be called from any thread; only the owning thread moves the bump
+  // pointer back or releases blocks
+  static void free(void *p) {
+    if (!p)
+      return;
+    Header *h = header(p);
+    Block *b = h->block;
+    DecodeArena *owner = b->owner.load(std::memory_order_relaxed);
+    bool local = owner && owner == self;
+    if (local && owner->isLast(h))
+      owner->offset -= sizeof(Header) + h->size;
+    b->used.fetch_sub(sizeof(Header) + h->size, std::memory_order_relaxed);
+    unref(b);
+    if (local && !owner->decoding)
+      owner->trim();
+  }
+
+  // bracket a decode; endDecode() returns the bytes it needed at its peak
+  void beginDecode() {
+    decoding = true;
+    decodeStart = usedBytes();
+    peakUsed = decodeStart;
+  }
+  size_t endDecode() {
+    decoding = false;
+    trim();
+    return peakUsed - decodeStart;
+  }
+
+private:
+  static constexpr size_t ALIGN = 16;
+  static constexpr size_t MIN_BLOCK = 4 << 20;
+
+  struct Block {
+    std::unique_ptr<unsigned char[]> data;
+    size_t size;
+    std::atomic<DecodeArena *> owner; // null once the thread has exited
+    std::atomic<int> live{1};         // allocations, plus one for the owner
+    std::atomic<size_t> used{0};      // bytes, headers included
+  };
+  struct alignas(16) Header {
+    size_t size;
+    Block *block;
+  };
+
+  std::vector<std::unique_ptr<Block>> blocks; // back() is being bumped
+  size_t offset = 0;
+  size_t peakUsed = 0, decodeStart = 0;
+  bool decoding = false;
+
+  static inline thread_local DecodeArena *self = nullptr;
+
+  Block &current() { return *blocks.back(); }
+
+  static bool empty(const Block &b) {
+    return b.live.load(std::memory_order_acquire) == 1;
+  }
+
+  static void unref(Block *b) {
+    if (b->live.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      delete b;
+  }
+
+  size_t usedBytes() const {
+    size_t sum = 0;
+    for (auto &b : blocks)
+      sum += b->used.load(std::memory_order_relaxed);
+    return sum;
+  }
+
+  void notePeak() { peakUsed = std::max(peakUsed, usedBytes()); }
+
+  // frees the empty blocks above MIN_BLOCK; if the one being bumped goes,
+  // the next allocation selects another
+  void trim() {
+    Block *bumped = blocks.empty() ? nullptr : blocks.back().get();
+    blocks.erase(std::remove_if(blocks.begin(), blocks.end(),
+                                [](const std::unique_ptr<Block> &b) {
+                                  return b->size > MIN_BLOCK && empty(*b);
+                                }),
+                 blocks.end());
+    if (blocks.empty() || blocks.back().get() != bumped)
+      offset = blocks.empty() ? 0 : current().size;
+  }
+
+  static Header *header(void *p) { return (Header *)p - 1; }
+
+  bool isLast(Header *h) {
+    return !blocks.empty() && h->block == blocks.back().get() &&
+           (unsigned char *)h + sizeof(Header) + h->size ==
+               current().data.get() + offset;
+  }
+
+  // reuse a fully freed block if one is big enough, otherwise allocate a
+  // new one at least double the previous size
+  void select(size_t need) {
+    for (size_t i = 0; i + 1 < blocks.size(); i++) {
+      Block &b = *blocks[i];
+      if (b.size >= need && empty(b)) {
+        std::swap(blocks[i], blocks.back());
+        offset = 0;
+        return;
+      }
+    }
+
+    size_t size = blocks.empty() ? MIN_BLOCK : current().size * 2;
+    while (size < need)
+      size *= 2;
+    auto b = std::make_unique<Block>();
+    b->data.reset(new unsigned char[size]);
+    b->size = size;
+    b->owner = this;
+    blocks.push_back(std::move(b));
+    offset = 0;
+  }
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+// Picks the render scale that keeps the GPU time of the scaled passes within
+// a budget. The cost of a pass scales with its pixel count, the square of
+// the scale, so the scale that would just fit is scale * sqrt(budget / ms).
+// The controller moves part of the way there each frame on a smoothed
+// time, ignores errors within a dead band, and snaps to steps so the
+// render targets are only reallocated on real changes.
+class DynamicResolution {
+public:
+  float minScale, maxScale;
+  double budgetMs;
+
+  explicit DynamicResolution(double budgetMs = 10.0, float minScale = 0.5f,
+                             float maxScale = 1.0f)
+      : minScale(minScale), maxScale(maxScale), budgetMs(budgetMs),
+        target(maxScale), current(maxScale) {}
+
+  // feed each new GPU time of the scaled work once, none measured before
+  // the last change of scale(); returns whether scale() changed
+  bool update(double gpuMs) {
+    if (gpuMs <= 0)
+      return false;
+    smoothedMs =
+        smoothedMs < 0 ? gpuMs : smoothedMs + (gpuMs - smoothedMs) * 0.1;
+
+    double ratio = budgetMs / smoothedMs;
+    if (std::fabs(ratio - 1.0) > DEAD_BAND) {
+      double ideal = current * std::sqrt(ratio);
+      target += (ideal - target) * GAIN;
+      target = std::min(std::max(target, (double)minScale), (double)maxScale);
+    }
+
+    float snapped = (float)(std::round(target / STEP) * STEP);
+    snapped = std::min(std::max(snapped, minScale), maxScale);
+    if (snapped == current)
+      return false;
+    // what the smoothed time would have been at the new scale
+    smoothedMs *= (double)snapped * snapped / ((double)current * current);
+    current = snapped;
+    return true;
+  }
+
+  // of the window size, for the scene's render targets
+  float scale() const { return current; }
+  double gpuMs() const { return smoothedMs; }
+
+  // back to full resolution, e.g. when scaling is turned off
+  void reset() {
+    target = current = maxScale;
+    smoothedMs = -1;
+  }
+
+private:
+  static constexpr double DEAD_BAND = 0.1; // of the budget
+  static constexpr double GAIN = 0.2;
+  static constexpr double STEP = 1.0 / 16;
+
+  double target;
+  float current;
+  double smoothedMs = -1;
+};
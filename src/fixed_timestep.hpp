@@ -0,0 +1,58 @@
+#pragma once
+
+#include <algorithm>
+
+// Runs the simulation in steps of a fixed length however long frames take,
+// so its cost and behaviour do not depend on the frame rate. What is left
+// over after the last whole step is returned as alpha() for the renderer to
+// interpolate between the previous and current state with.
+class FixedTimestep {
+public:
+  struct Stats {
+    int lastSteps = 0;          // steps run by the latest advance()
+    int maxSteps = 0;           // most steps run by a single frame
+    double meanSteps = 0;       // per rendered frame, smoothed
+    long long droppedSteps = 0; // skipped when a frame fell too far behind
+  };
+
+  double step;  // seconds per simulation step
+  int maxSteps; // per frame; beyond that time is dropped, not caught up on
+
+  explicit FixedTimestep(double step = 1.0 / 120.0, int maxSteps = 8)
+      : step(step), maxSteps(maxSteps) {}
+
+  // Adds frameSeconds of real time and calls update(step) once per whole
+  // step it covers. Returns the number of steps run.
+  template <typename Fn> int advance(double frameSeconds, Fn &&update) {
+    accumulator += std::max(frameSeconds, 0.0);
+
+    int steps = 0;
+    while (accumulator >= step && steps < maxSteps) {
+      update(step);
+      accumulator -= step;
+      steps++;
+    }
+    // a stall (breakpoint, window drag) would otherwise have the
+    // simulation run ever more steps to catch up
+    if (accumulator >= step) {
+      long long behind = (long long)(accumulator / step);
+      stats.droppedSteps += behind;
+      accumulator -= behind * step;
+    }
+
+    stats.lastSteps = steps;
+    stats.maxSteps = std::max(stats.maxSteps, steps);
+    stats.meanSteps += (steps - stats.meanSteps) * 0.05;
+    return steps;
+  }
+
+  // how far real time is between the previous and the current step, 0..1
+  double alpha() const { return accumulator / step; }
+
+  const Stats &statistics() const { return stats; }
+  void resetStatistics() { stats = Stats(); }
+
+private:
+  double accumulator = 0;
+  Stats stats;
+};
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "debug.hpp"
+#include "image_writer.hpp"
+
+// Screenshots and video capture without stalling the GPU. capture() only
+// queues a glReadPixels into one of a ring of pixel pack buffers and fences
+// it; update() maps the reads that have finished, a few frames later, and
+// hands a copy to a worker thread that writes the PNG or Y4M. When every
+// buffer is still in flight, or the worker falls behind, the frame is left
+// out of the capture rather than waited for.
+class FrameCapture {
+public:
+  struct Stats {
+    long long captured = 0; // frames written or queued for writing
+    long long dropped = 0;  // frames recording had to skip
+  };
+
+  // needs a current GL context, as does every call after
+  explicit FrameCapture(int buffers = 3) : slots(buffers) {
+    for (Slot &s : slots)
+      glGenBuffers(1, &s.pbo);
+    worker = std::thread(&FrameCapture::work, this);
+  }
+
+  ~FrameCapture() {
+    for (Slot &s : slots) {
+      if (s.fence)
+        glDeleteSync(s.fence);
+      glDeleteBuffers(1, &s.pbo);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+  }
+
+  FrameCapture(const FrameCapture &) = delete;
+  FrameCapture &operator=(const FrameCapture &) = delete;
+
+  // the next captured frame is written to path
+  void screenshot(const std::string &path) { screenshotPath = path; }
+
+  // every frame, at most fps a second, until stopRecording()
+  void startRecording(const std::string &path, int fps = 60) {
+    stopRecording();
+    video = std::make_shared<Video>();
+    video->path = path;
+    video->fps = fps;
+    videoPeriod = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0 / fps));
+    nextVideoFrame = Clock::now();
+    droppedBefore = stats.dropped;
+    DBG("CAPTURE::RECORDING " << path);
+  }
+
+  // frames already read back are still written
+  void stopRecording() {
+    if (video)
+      DBG("CAPTURE::STOPPED " << video->path << ", "
+                              << stats.dropped - droppedBefore
+                              << " frames dropped");
+    video.reset();
+  }
+
+  bool recording() const { return video != nullptr; }
+
+  // whether capture() would read this frame
+  bool wanted() const {
+    return !screenshotPath.empty() ||
+           (video && Clock::now() >= nextVideoFrame);
+  }
+
+  // Queues a read of fbo's first colour attachment, or the back buffer for
+  // 0, once it has been drawn.
+  void capture(unsigned int fbo, int width, int height) {
+    // e.g. minimized; Y4M needs at least one 2x2 chroma block
+    if (!wanted() || width < 2 || height < 2)
+      return;
+    Slot &s = slots[next];
+    if (s.fence) {
+      // all buffers in flight; a screenshot waits for the next frame
+      if (screenshotPath.empty())
+        stats.dropped++;
+      return;
+    }
+
+    s.width = width;
+    s.height = height;
+    s.png = screenshotPath;
+    screenshotPath.clear();
+    s.video = video;
+    if (video) {
+      // keep to the grid unless far behind it
+      nextVideoFrame += videoPeriod;
+      if (Clock::now() > nextVideoFrame + videoPeriod)
+        nextVideoFrame = Clock::now() + videoPeriod;
+    }
+
+    size_t bytes = (size_t)width * height * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+    if (bytes > s.capacity) {
+      glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+      s.capacity = bytes;
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glReadBuffer(fbo ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    // with a pack buffer bound this returns at once, the copy runs on the GPU
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    next = (next + 1) % slots.size();
+  }
+
+  // Passes finished reads to the worker, oldest first. Call once a frame.
+  void update() {
+    while (slots[oldest].fence) {
+      Slot &s = slots[oldest];
+      GLenum status = glClientWaitSync(s.fence, 0, 0);
+      if (status == GL_TIMEOUT_EXPIRED)
+        break;
+      glDeleteSync(s.fence);
+      s.fence = nullptr;
+      oldest = (oldest + 1) % slots.size();
+      if (status == GL_WAIT_FAILED)
+        continue;
+
+      Job job;
+      job.png = std::move(s.png);
+      job.video = std::move(s.video);
+      job.width = s.width;
+      job.height = s.height;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        // a screenshot always gets through, video only while the worker
+        // keeps up
+        if (job.png.empty() && jobs.size() >= MAX_QUEUED) {
+          stats.dropped++;
+          continue;
+        }
+        if (!spare.empty()) {
+          job.pixels = std::move(spare.back());
+          spare.pop_back();
+        }
+      }
+
+      size_t bytes = (size_t)s.width * s.height * 4;
+      job.pixels.resize(bytes);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+      void *mapped =
+          glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+      bool ok = mapped != nullptr;
+      if (ok) {
+        std::memcpy(job.pixels.data(), mapped, bytes);
+        ok = glUnmapBuffer(GL_PIXEL_PACK_BUFFER) == GL_TRUE;
+      }
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+      if (!ok) {
+        DBG("CAPTURE::MAP_FAILED");
+        continue;
+      }
+
+      stats.captured++;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+      }
+      wake.notify_one();
+    }
+  }
+
+  const Stats &statistics() const { return stats; }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  // frames waiting for the worker, beyond which recording drops them
+  static constexpr size_t MAX_QUEUED = 8;
+
+  // opened by the worker on the first frame, closed with the last job
+  // holding it
+  struct Video {
+    std::string path;
+    int fps = 60;
+    Y4mWriter writer;
+    int segments = 0; // files opened, one per frame size
+    bool failed = false;
+  };
+
+  struct Slot {
+    unsigned int pbo = 0;
+    size_t capacity = 0;
+    GLsync fence = nullptr; // set while a read is in flight
+    int width = 0, height = 0;
+    std::string png;
+    std::shared_ptr<Video> video;
+  };
+
+  struct Job {
+    std::string png;
+    std::shared_ptr<Video> video;
+    int width = 0, height = 0;
+    std::vector<unsigned char> pixels; // RGBA, bottom row first
+  };
+
+  std::vector<Slot> slots;
+  size_t next = 0, oldest = 0;
+  std::string screenshotPath;
+  std::shared_ptr<Video> video;
+  Clock::duration videoPeriod{};
+  Clock::time_point nextVideoFrame;
+  Stats stats;
+  long long droppedBefore = 0; // stats.dropped when recording started
+
+  // shared with the worker
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<Job> jobs;
+  std::vector<std::vector<unsigned char>> spare; // pixel buffers to reuse
+  bool stopping = false;
+  std::thread worker;
+
+  void work() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      wake.wait(lock, [&] { return stopping || !jobs.empty(); });
+      if (jobs.empty())
+        return;
+      Job job = std::move(jobs.front());
+      jobs.pop_front();
+      lock.unlock();
+
+      if (!job.png.empty()) {
+        if (writePng(job.png, job.width, job.height, job.pixels.data()))
+          DBG("CAPTURE::SCREENSHOT " << job.png);
+        else
+          DBG("CAPTURE::WRITE_FAILED " << job.png);
+      }
+      if (job.video)
+        writeFrame(*job.video, job);
+      job.video.reset();
+
+      lock.lock();
+      spare.push_back(std::move(job.pixels));
+    }
+  }
+
+  // Y4M has one size for the whole stream, so a resize starts a new file
+  // next to the first, e.g. capture-2.y4m after capture.y4m
+  static void writeFrame(Video &v, const Job &job) {
+    if (v.failed)
+      return;
+    if (!v.writer.isOpen() || (job.width & ~1) != v.writer.frameWidth() ||
+        (job.height & ~1) != v.writer.frameHeight()) {
+      std::string path = segmentPath(v.path, ++v.segments);
+      if (!v.writer.open(path, job.width, job.height, v.fps)) {
+        DBG("CAPTURE::WRITE_FAILED " << path);
+        v.failed = true;
+        return;
+      }
+      if (v.segments > 1)
+        DBG("CAPTURE::SEGMENT " << path << " " << v.writer.frameWidth()
+                                << "x" << v.writer.frameHeight());
+    }
+    v.writer.write(job.width, job.height, job.pixels.data());
+  }
+
+  static std::string segmentPath(const std::string &path, int segment) {
+    if (segment == 1)
+      return path;
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+      dot = path.size();
+    return path.substr(0, dot) + "-" + std::to_string(segment) +
+           path.substr(dot);
+  }
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+#include "debug.hpp"
+
+enum class PresentMode {
+  VSync,    // swap interval 1
+  Adaptive, // late frames tear instead of waiting a whole refresh
+  Capped,   // no vsync, the pacer sleeps up to a target frame rate
+  Uncapped, // no vsync and no waiting, for benchmarking
+};
+
+// Sets the swap interval for the chosen mode and, when capped, holds each
+// frame until its deadline: a plain sleep gets close, the last stretch is
+// spun out because sleeps overshoot by up to a scheduler tick. It also
+// keeps the recent frame-to-frame intervals to report their jitter.
+class FramePacer {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Stats {
+    double meanMs = 0;   // average frame interval
+    double jitterMs = 0; // standard deviation of the intervals
+    double minMs = 0, maxMs = 0;
+    int frames = 0;
+  };
+
+  // needs the window's context current
+  explicit FramePacer(PresentMode mode = PresentMode::VSync,
+                      double capFps = 120.0) {
+    setMode(mode, capFps);
+  }
+
+  void setMode(PresentMode newMode, double capFps = 120.0) {
+    mode = newMode;
+    period = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0 / std::max(capFps, 1.0)));
+
+    int interval = 0;
+    if (mode == PresentMode::VSync)
+      interval = 1;
+    else if (mode == PresentMode::Adaptive)
+      // negative intervals need the swap_control_tear extension
+      interval = glfwExtensionSupported("WGL_EXT_swap_control_tear") ||
+                         glfwExtensionSupported("GLX_EXT_swap_control_tear")
+                     ? -1
+                     : 1;
+    glfwSwapInterval(interval);
+
+    deadline = Clock::now() + period;
+    count = 0;
+    last = Clock::time_point();
+  }
+
+  PresentMode presentMode() const { return mode; }
+
+  static const char *name(PresentMode mode) {
+    switch (mode) {
+    case PresentMode::VSync:
+      return "vsync";
+    case PresentMode::Adaptive:
+      return "adaptive";
+    case PresentMode::Capped:
+      return "capped";
+    default:
+      return "uncapped";
+    }
+  }
+
+  // call right before glfwSwapBuffers
+  void wait() {
+    if (mode != PresentMode::Capped)
+      return;
+
+    Clock::time_point now = Clock::now();
+    if (deadline - now > spinMargin)
+      std::this_thread::sleep_for(deadline - now - spinMargin);
+    while (Clock::now() < deadline)
+      ;
+
+    // keep to the grid so the rate does not drift, unless far behind it
+    deadline += period;
+    now = Clock::now();
+    if (now > deadline)
+      deadline = now + period;
+  }
+
+  // call right after glfwSwapBuffers
+  void presented() {
+    Clock::time_point now = Clock::now();
+    if (last != Clock::time_point()) {
+      intervals[count % HISTORY] =
+          std::chrono::duration<double, std::milli>(now - last).count();
+      count++;
+    }
+    last = now;
+  }
+
+  // over the last HISTORY frames
+  Stats stats() const {
+    Stats s;
+    s.frames = std::min(count, HISTORY);
+    if (!s.frames)
+      return s;
+
+    double sum = 0, squares = 0;
+    s.minMs = s.maxMs = intervals[0];
+    for (int i = 0; i < s.frames; i++) {
+      sum += intervals[i];
+      squares += intervals[i] * intervals[i];
+      s.minMs = std::min(s.minMs, intervals[i]);
+      s.maxMs = std::max(s.maxMs, intervals[i]);
+    }
+    s.meanMs = sum / s.frames;
+    double variance = squares / s.frames - s.meanMs * s.meanMs;
+    s.jitterMs = std::sqrt(std::max(0.0, variance));
+    return s;
+  }
+
+private:
+  static constexpr int HISTORY = 240;
+  // how much of the wait is spun rather than slept
+  static constexpr Clock::duration spinMargin =
+      std::chrono::microseconds(1500);
+
+  PresentMode mode = PresentMode::VSync;
+  Clock::duration period{};
+  Clock::time_point deadline, last;
+  double intervals[HISTORY] = {};
+  int count = 0;
+};
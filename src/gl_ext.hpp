@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// glad is generated for plain GL 3.3, so anything newer is picked up here at
+// runtime. Call GLExt::load once the context is current.
+
+#ifndef GL_TEXTURE_MAX_ANISOTROPY_EXT
+#define GL_TEXTURE_MAX_ANISOTROPY_EXT 0x84FE
+#endif
+#ifndef GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT
+#define GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT 0x84FF
+#endif
+
+// KHR_parallel_shader_compile, same values as the ARB variant
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void(APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+typedef void(APIENTRYP PFNGLTEXSTORAGE2DPROC)(GLenum target, GLsizei levels,
+                                              GLenum internalformat,
+                                              GLsizei width, GLsizei height);
+
+struct GLExt {
+  static inline bool textureStorage = false;
+  static inline bool anisotropy = false;
+  static inline float maxAnisotropy = 1.0f;
+  // GL_COMPLETION_STATUS_KHR can be polled without blocking
+  static inline bool parallelShaderCompile = false;
+
+  static inline PFNGLTEXSTORAGE2DPROC TexStorage2D = nullptr;
+  static inline PFNGLMAXSHADERCOMPILERTHREADSKHRPROC
+      MaxShaderCompilerThreads = nullptr;
+
+  static bool supported(const char *name) {
+    int count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (int i = 0; i < count; i++) {
+      const char *ext = (const char *)glGetStringi(GL_EXTENSIONS, i);
+      if (ext && std::strcmp(ext, name) == 0)
+        return true;
+    }
+    return false;
+  }
+
+  static void load(GLADloadproc loader) {
+    if (supported("GL_ARB_texture_storage")) {
+      TexStorage2D = (PFNGLTEXSTORAGE2DPROC)loader("glTexStorage2D");
+      textureStorage = TexStorage2D != nullptr;
+    }
+
+    anisotropy = supported("GL_ARB_texture_filter_anisotropic") ||
+                 supported("GL_EXT_texture_filter_anisotropic");
+    if (anisotropy)
+      glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+
+    if (supported("GL_KHR_parallel_shader_compile"))
+      MaxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)loader(
+          "glMaxShaderCompilerThreadsKHR");
+    else if (supported("GL_ARB_parallel_shader_compile"))
+      MaxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)loader(
+          "glMaxShaderCompilerThreadsARB");
+    parallelShaderCompile = MaxShaderCompilerThreads != nullptr;
+    // some drivers only compile in the background once asked to
+    if (parallelShaderCompile)
+      MaxShaderCompilerThreads(0xFFFFFFFF);
+  }
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Measures how long the GPU spends on the commands between begin() and
+// end(), from GL_TIMESTAMP queries. Results arrive a few frames late: each
+// frame uses the next of a ring of query pairs, and only pairs whose result
+// is already available are read, so timing never stalls the pipeline.
+// Timestamps, unlike GL_TIME_ELAPSED, may nest and overlap.
+class GpuTimer {
+public:
+  GpuTimer() { glGenQueries(2 * FRAMES, queries); }
+  ~GpuTimer() { glDeleteQueries(2 * FRAMES, queries); }
+
+  GpuTimer(const GpuTimer &) = delete;
+  GpuTimer &operator=(const GpuTimer &) = delete;
+
+  // at most one begin()/end() pair per frame
+  void begin() {
+    collect();
+    if (issued[current])
+      return; // the ring is full of pending results, skip this frame
+    glQueryCounter(queries[2 * current], GL_TIMESTAMP);
+  }
+  void end() {
+    if (issued[current])
+      return;
+    glQueryCounter(queries[2 * current + 1], GL_TIMESTAMP);
+    issued[current] = true;
+    pair[current] = ++pairs;
+    current = (current + 1) % FRAMES;
+  }
+
+  // the latest finished measurement, negative before the first
+  double milliseconds() const { return latest; }
+
+  // Which begin()/end() pair milliseconds() measured, counting from 1, 0
+  // before the first. A new value means a new measurement; the same one
+  // the same measurement read again.
+  long long sample() const { return latestPair; }
+  // begin()/end() pairs issued so far; samples up to this one were taken
+  // before anything that changes now
+  long long issuedPairs() const { return pairs; }
+
+private:
+  static constexpr int FRAMES = 4;
+
+  unsigned int queries[2 * FRAMES];
+  bool issued[FRAMES] = {};
+  long long pair[FRAMES] = {};
+  int current = 0, oldest = 0;
+  long long pairs = 0, latestPair = 0;
+  double latest = -1;
+
+  void collect() {
+    while (issued[oldest]) {
+      int available = 0;
+      glGetQueryObjectiv(queries[2 * oldest + 1], GL_QUERY_RESULT_AVAILABLE,
+                         &available);
+      if (!available)
+        return;
+      GLuint64 start = 0, stop = 0;
+      glGetQueryObjectui64v(queries[2 * oldest], GL_QUERY_RESULT, &start);
+      glGetQueryObjectui64v(queries[2 * oldest + 1], GL_QUERY_RESULT, &stop);
+      latest = (stop - start) / 1e6;
+      latestPair = pair[oldest];
+      issued[oldest] = false;
+      oldest = (oldest + 1) % FRAMES;
+    }
+  }
+};
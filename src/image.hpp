@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "assets.hpp"
+#include "jpeg_decoder.hpp"
+#include "stb_impl.hpp"
+
+// Row order of decoded pixels. Native keeps the file's top-down order, which
+// is what GL sees as v = 0 at the top; geometry uses matching texcoords so
+// nothing has to be reordered on the CPU.
+enum class Orientation { Native, FlipVertical };
+
+// Reverses the rows of a tightly packed image in place. Rows are swapped a
+// chunk at a time through a stack buffer so the copies go through the
+// vectorised memcpy rather than a byte loop.
+inline void flip_rows(unsigned char *data, int width, int height,
+                      int channels) {
+  const size_t stride = (size_t)width * channels;
+  unsigned char tmp[4096];
+  for (int y = 0; y < height / 2; y++) {
+    unsigned char *top = data + stride * y;
+    unsigned char *bottom = data + stride * (height - 1 - y);
+    for (size_t off = 0; off < stride; off += sizeof(tmp)) {
+      size_t n = std::min(sizeof(tmp), stride - off);
+      std::memcpy(tmp, top + off, n);
+      std::memcpy(top + off, bottom + off, n);
+      std::memcpy(bottom + off, tmp, n);
+    }
+  }
+}
+
+// path is an asset path (see assets.hpp); failures are reported through
+// stbi_failure_reason like decode errors
+inline bool read_file(const char *path, std::vector<unsigned char> &out) {
+  if (Assets::read(path, out))
+    return true;
+  return stbi__err("can't fopen", "Unable to open file");
+}
+
+// What decode_into will write, known from the file header alone.
+struct ImageInfo {
+  int width = 0, height = 0, channels = 0;
+
+  size_t bytes() const { return (size_t)width * height * channels; }
+};
+
+inline bool image_info(const std::vector<unsigned char> &file,
+                       int desiredChannels, ImageInfo &info) {
+  int fileChannels;
+  if (!stbi_info_from_memory(file.data(), (int)file.size(), &info.width,
+                             &info.height, &fileChannels))
+    return false;
+  info.channels = desiredChannels ? desiredChannels : fileChannels;
+  return true;
+}
+
+// Decodes into caller-owned memory, e.g. a mapped pixel unpack buffer, which
+// must hold info.bytes(). Baseline JPEGs are written there directly; other
+// formats still pass through a temporary stbi buffer. Avoid FlipVertical
+// when dst is GPU-mapped, the flip has to read it back.
+inline bool decode_into(const std::vector<unsigned char> &file,
+                        const ImageInfo &info, unsigned char *dst,
+                        Orientation orientation = Orientation::Native) {
+  stbi_set_flip_vertically_on_load_thread(0);
+
+  int w, h, c;
+  bool ok = JpegDecoder().decode(file.data(), file.size(), &w, &h, &c,
+                                 info.channels, dst, info.bytes()) != nullptr;
+  if (!ok) {
+    unsigned char *data = stbi_load_from_memory(
+        file.data(), (int)file.size(), &w, &h, &c, info.channels);
+    ok = data && w == info.width && h == info.height;
+    if (ok)
+      std::memcpy(dst, data, info.bytes());
+    stbi_image_free(data);
+  }
+
+  if (ok && orientation == Orientation::FlipVertical)
+    flip_rows(dst, info.width, info.height, info.channels);
+  return ok;
+}
+
+// Owns one decoded image. Baseline JPEGs go through the multithreaded
+// JpegDecoder, everything else through stbi.
+class Image {
+public:
+  unsigned char *data = nullptr;
+  int width = 0, height = 0, channels = 0;
+  size_t decodePeak = 0; // bytes of scratch + output the decode needed
+
+  Image(const char *path, int desiredChannels = 0,
+        Orientation orientation = Orientation::Native) {
+    // never let stb do its own flip pass; the flag is per thread so other
+    // decoders are unaffected
+    stbi_set_flip_vertically_on_load_thread(0);
+
+    std::vector<unsigned char> file;
+    if (!read_file(path, file))
+      return;
+
+    DecodeArena &arena = DecodeArena::local();
+    arena.beginDecode();
+
+    int fileChannels;
+    data = JpegDecoder().decode(file.data(), file.size(), &width, &height,
+                                &fileChannels, desiredChannels);
+    if (!data)
+      data = stbi_load_from_memory(file.data(), (int)file.size(), &width,
+                                   &height, &fileChannels, desiredChannels);
+    decodePeak = arena.endDecode();
+    if (!data)
+      return;
+    channels = desiredChannels ? desiredChannels : fileChannels;
+
+    if (orientation == Orientation::FlipVertical)
+      flip_rows(data, width, height, channels);
+  }
+
+  Image(const Image &) = delete;
+  Image &operator=(const Image &) = delete;
+  Image(Image &&o) noexcept { *this = std::move(o); }
+  Image &operator=(Image &&o) noexcept {
+    std::swap(data, o.data);
+    std::swap(width, o.width);
+    std::swap(height, o.height);
+    std::swap(channels, o.channels);
+    std::swap(decodePeak, o.decodePeak);
+    return *this;
+  }
+
+  ~Image() { stbi_image_free(data); }
+
+  explicit operator bool() const { return data != nullptr; }
+
+  static const char *failure() { return stbi_failure_reason(); }
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Writers for captured frames. Pixels are tightly packed RGBA8 with the
+// bottom row first, as glReadPixels returns them.
+
+// An RGB PNG. The deflate stream uses stored blocks only: a 1080p frame is
+// written in milliseconds, which matters more here than the file size.
+inline bool writePng(const std::string &path, int width, int height,
+                     const unsigned char *rgba) {
+  static const std::array<uint32_t, 256> crcTable = [] {
+    std::array<uint32_t, 256> table;
+    for (uint32_t n = 0; n < 256; n++) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; k++)
+        c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      table[n] = c;
+    }
+    return table;
+  }();
+
+  // PNG integers are big-endian
+  auto u32 = [](std::vector<unsigned char> &to, uint32_t v) {
+    for (int shift = 24; shift >= 0; shift -= 8)
+      to.push_back((unsigned char)(v >> shift));
+  };
+  std::vector<unsigned char> out = {0x89, 'P',  'N',  'G',
+                                    '\r', '\n', 0x1A, '\n'};
+  auto chunk = [&](const char *type, const std::vector<unsigned char> &data) {
+    u32(out, (uint32_t)data.size());
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = start; i < out.size(); i++)
+      crc = crcTable[(crc ^ out[i]) & 0xFF] ^ (crc >> 8);
+    u32(out, crc ^ 0xFFFFFFFFu);
+  };
+
+  // filter type 0 then RGB for each row, flipped to top-down
+  size_t rowBytes = 1 + (size_t)width * 3;
+  std::vector<unsigned char> raw(rowBytes * height);
+  for (int y = 0; y < height; y++) {
+    unsigned char *dst = &raw[rowBytes * y];
+    const unsigned char *src = rgba + (size_t)width * 4 * (height - 1 - y);
+    *dst++ = 0;
+    for (int x = 0; x < width; x++, src += 4) {
+      *dst++ = src[0];
+      *dst++ = src[1];
+      *dst++ = src[2];
+    }
+  }
+
+  // zlib header, stored blocks of up to 64K, adler32
+  std::vector<unsigned char> z = {0x78, 0x01};
+  z.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+  size_t pos = 0;
+  do {
+    size_t len = std::min<size_t>(raw.size() - pos, 65535);
+    z.push_back(pos + len == raw.size() ? 1 : 0);
+    z.push_back((unsigned char)len);
+    z.push_back((unsigned char)(len >> 8));
+    z.push_back((unsigned char)~len);
+    z.push_back((unsigned char)(~len >> 8));
+    z.insert(z.end(), raw.begin() + pos, raw.begin() + pos + len);
+    pos += len;
+  } while (pos < raw.size());
+  uint32_t a = 1, b = 0;
+  for (size_t i = 0; i < raw.size(); i++) {
+    a = (a + raw[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  u32(z, (b << 16) | a);
+
+  std::vector<unsigned char> header;
+  u32(header, (uint32_t)width);
+  u32(header, (uint32_t)height);
+  header.insert(header.end(), {8, 2, 0, 0, 0}); // 8 bit RGB, no interlace
+  chunk("IHDR", header);
+  chunk("IDAT", z);
+  chunk("IEND", {});
+
+  FILE *file = std::fopen(path.c_str(), "wb");
+  if (!file)
+    return false;
+  bool ok = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+  return std::fclose(file) == 0 && ok;
+}
+
+// Raw YUV 4:2:0 video that ffmpeg and most players read directly. Every
+// frame must have the size of the first; odd sizes lose their last row or
+// column.
+class Y4mWriter {
+public:
+  ~Y4mWriter() { close(); }
+
+  bool open(const std::string &path, int width, int height, int fps) {
+    close();
+    this->width = width & ~1;
+    this->height = height & ~1;
+    file = std::fopen(path.c_str(), "wb");
+    if (!file)
+      return false;
+    std::fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n",
+                 this->width, this->height, fps);
+    plane.resize((size_t)this->width * this->height * 3 / 2);
+    return true;
+  }
+
+  bool isOpen() const { return file != nullptr; }
+  int frameWidth() const { return width; }
+  int frameHeight() const { return height; }
+
+  // full range BT.601, chroma averaged over each 2x2 block
+  bool write(int srcWidth, int srcHeight, const unsigned char *rgba) {
+    if (!file)
+      return false;
+    unsigned char *Y = plane.data();
+    unsigned char *U = Y + (size_t)width * height;
+    unsigned char *V = U + (size_t)width * height / 4;
+    for (int y = 0; y < height; y += 2)
+      for (int x = 0; x < width; x += 2) {
+        float u = 0, v = 0;
+        for (int dy = 0; dy < 2; dy++)
+          for (int dx = 0; dx < 2; dx++) {
+            size_t row = (size_t)(srcHeight - 1 - y - dy) * srcWidth;
+            const unsigned char *p = rgba + (row + x + dx) * 4;
+            float r = p[0], g = p[1], b = p[2];
+            Y[(size_t)(y + dy) * width + x + dx] =
+                clamp(0.299f * r + 0.587f * g + 0.114f * b);
+            u += -0.168736f * r - 0.331264f * g + 0.5f * b;
+            v += 0.5f * r - 0.418688f * g - 0.081312f * b;
+          }
+        size_t c = (size_t)(y / 2) * (width / 2) + x / 2;
+        U[c] = clamp(u / 4 + 128);
+        V[c] = clamp(v / 4 + 128);
+      }
+    std::fputs("FRAME\n", file);
+    return std::fwrite(plane.data(), 1, plane.size(), file) == plane.size();
+  }
+
+  void close() {
+    if (file)
+      std::fclose(file);
+    file = nullptr;
+  }
+
+private:
+  FILE *file = nullptr;
+  int width = 0, height = 0;
+  std::vector<unsigned char> plane;
+
+  static unsigned char clamp(float v) {
+    return (unsigned char)std::min(std::max(v + 0.5f, 0.0f), 255.0f);
+  }
+};
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <GLFW/glfw3.h>
+
+#include <bitset>
+#include <vector>
+
+#include "debug.hpp"
+#include "spsc_ring.hpp"
+
+struct InputEvent {
+  enum Type { Key, MouseButton, CursorMove, Scroll, Resize };
+
+  Type type;
+  double time; // glfwGetTime() when the callback ran
+  // Key: key, scancode, action, mods. MouseButton: key is the button
+  int key = 0, scancode = 0, action = 0, mods = 0;
+  // CursorMove: position. Scroll: offset. Resize: framebuffer size
+  double x = 0, y = 0;
+};
+
+// What the input looked like after the latest update(), for polling.
+struct InputState {
+  std::bitset<GLFW_KEY_LAST + 1> keys;     // held down
+  std::bitset<GLFW_KEY_LAST + 1> pressed;  // went down this update
+  std::bitset<GLFW_KEY_LAST + 1> released; // went up this update
+  std::bitset<GLFW_MOUSE_BUTTON_LAST + 1> buttons;
+  double cursorX = 0, cursorY = 0;
+  double scrollX = 0, scrollY = 0; // summed over this update
+  int width = 0, height = 0;       // framebuffer size
+  bool resized = false;
+
+  bool down(int key) const {
+    return key >= 0 && key <= GLFW_KEY_LAST && keys[key];
+  }
+  bool wasPressed(int key) const {
+    return key >= 0 && key <= GLFW_KEY_LAST && pressed[key];
+  }
+};
+
+// Installs the window's key, mouse, scroll and resize callbacks. They only
+// timestamp the event and push it onto a lock-free ring, so they never
+// block; whichever thread consumes input calls update() once a frame to
+// drain it into the state and the list of events. One window per Input.
+class Input {
+public:
+  explicit Input(GLFWwindow *window) : window(window) {
+    glfwSetWindowUserPointer(window, this);
+    glfwGetFramebufferSize(window, &current.width, &current.height);
+    glfwGetCursorPos(window, &current.cursorX, &current.cursorY);
+
+    glfwSetKeyCallback(window, [](GLFWwindow *w, int key, int scancode,
+                                  int action, int mods) {
+      InputEvent e{InputEvent::Key, glfwGetTime()};
+      e.key = key;
+      e.scancode = scancode;
+      e.action = action;
+      e.mods = mods;
+      from(w).push(e);
+    });
+    glfwSetMouseButtonCallback(
+        window, [](GLFWwindow *w, int button, int action, int mods) {
+          InputEvent e{InputEvent::MouseButton, glfwGetTime()};
+          e.key = button;
+          e.action = action;
+          e.mods = mods;
+          from(w).push(e);
+        });
+    glfwSetCursorPosCallback(window, [](GLFWwindow *w, double x, double y) {
+      InputEvent e{InputEvent::CursorMove, glfwGetTime()};
+      e.x = x;
+      e.y = y;
+      from(w).push(e);
+    });
+    glfwSetScrollCallback(window, [](GLFWwindow *w, double x, double y) {
+      InputEvent e{InputEvent::Scroll, glfwGetTime()};
+      e.x = x;
+      e.y = y;
+      from(w).push(e);
+    });
+    glfwSetFramebufferSizeCallback(window, [](GLFWwindow *w, int width,
+                                              int height) {
+      InputEvent e{InputEvent::Resize, glfwGetTime()};
+      e.x = width;
+      e.y = height;
+      from(w).push(e);
+    });
+  }
+
+  ~Input() {
+    glfwSetKeyCallback(window, NULL);
+    glfwSetMouseButtonCallback(window, NULL);
+    glfwSetCursorPosCallback(window, NULL);
+    glfwSetScrollCallback(window, NULL);
+    glfwSetFramebufferSizeCallback(window, NULL);
+    glfwSetWindowUserPointer(window, NULL);
+  }
+
+  Input(const Input &) = delete;
+  Input &operator=(const Input &) = delete;
+
+  // consumer: drains everything queued since the last call. The events stay
+  // in events() until the next update
+  void update() {
+    current.pressed.reset();
+    current.released.reset();
+    current.scrollX = current.scrollY = 0;
+    current.resized = false;
+    drained.clear();
+
+    InputEvent e;
+    while (ring.pop(e)) {
+      apply(e);
+      drained.push_back(e);
+    }
+  }
+
+  const InputState &state() const { return current; }
+  const std::vector<InputEvent> &events() const { return drained; }
+
+private:
+  // at a few thousand events a second from a gaming mouse this still holds
+  // several frames' worth
+  static constexpr size_t CAPACITY = 1024;
+
+  GLFWwindow *window;
+  SpscRing<InputEvent, CAPACITY> ring;
+  InputState current;
+  std::vector<InputEvent> drained;
+  bool overflowed = false; // producer only
+
+  static Input &from(GLFWwindow *window) {
+    return *(Input *)glfwGetWindowUserPointer(window);
+  }
+
+  // producer: a full ring drops the event rather than waiting
+  void push(const InputEvent &e) {
+    if (ring.push(e)) {
+      overflowed = false;
+    } else if (!overflowed) {
+      overflowed = true;
+      DBG("INPUT::OVERFLOW events are being dropped");
+    }
+  }
+
+  void apply(const InputEvent &e) {
+    switch (e.type) {
+    case InputEvent::Key:
+      if (e.key < 0 || e.key > GLFW_KEY_LAST)
+        break;
+      if (e.action == GLFW_PRESS) {
+        current.keys[e.key] = true;
+        current.pressed[e.key] = true;
+      } else if (e.action == GLFW_RELEASE) {
+        current.keys[e.key] = false;
+        current.released[e.key] = true;
+      }
+      break;
+    case InputEvent::MouseButton:
+      if (e.key >= 0 && e.key <= GLFW_MOUSE_BUTTON_LAST)
+        current.buttons[e.key] = e.action == GLFW_PRESS;
+      break;
+    case InputEvent::CursorMove:
+      current.cursorX = e.x;
+      current.cursorY = e.y;
+      break;
+    case InputEvent::Scroll:
+      current.scrollX += e.x;
+      current.scrollY += e.y;
+      break;
+    case InputEvent::Resize:
+      current.width = (int)e.x;
+      current.height = (int)e.y;
+      current.resized = true;
+      break;
+    }
+  }
+};
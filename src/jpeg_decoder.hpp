@@ -0,0 +1,396 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "stb_impl.hpp"
+
+// Runs fn(begin, end) over [0, count) split into one contiguous range per
+// thread; the calling thread takes the first range.
+template <typename Fn>
+inline void parallel_for(int count, unsigned threads, const Fn &fn) {
+  int n = (int)std::max(1u, std::min<unsigned>(threads, count));
+  if (n <= 1) {
+    fn(0, count);
+    return;
+  }
+  std::vector<std::thread> workers;
+  auto range = [&](int t) { return (int)((long long)count * t / n); };
+  for (int t = 1; t < n; t++)
+    workers.emplace_back([&, t] { fn(range(t), range(t + 1)); });
+  fn(0, range(1));
+  for (auto &w : workers)
+    w.join();
+}
+
+// Baseline JPEG decoder that spreads the work of stb_image's decoder across
+// cores. It reuses stb's huffman, IDCT and resampling kernels directly, so
+// the output is byte-for-byte what stbi_load produces:
+//
+//  - with restart markers, each restart interval is an independent
+//    bitstream, so segments are entropy decoded and IDCT'd in parallel;
+//  - without them, entropy decoding is serial into a coefficient buffer and
+//    the IDCT runs in parallel over MCU rows;
+//  - upsampling and colour conversion run in parallel over bands of output
+//    rows.
+//
+// Images under minPixels are decoded the same way on the calling thread.
+// Progressive, multi-scan and CMYK images return nullptr so the caller can
+// fall back to stbi_load.
+class JpegDecoder {
+public:
+  unsigned threads;
+  size_t minPixels; // spawning threads is not worth it below this
+
+  JpegDecoder(unsigned threads = 0, size_t minPixels = 1 << 20)
+      : threads(threads ? threads
+                        : std::max(1u, std::thread::hardware_concurrency())),
+        minPixels(minPixels) {}
+
+  // Same contract as stbi_load_from_memory; free with stbi_image_free.
+  // With dst the pixels are written there instead (dstSize must be at least
+  // x * y * channels) and dst is returned.
+  unsigned char *decode(const unsigned char *buffer, size_t len, int *x,
+                        int *y, int *comp, int req_comp,
+                        unsigned char *dst = nullptr, size_t dstSize = 0) {
+    if (req_comp < 0 || req_comp > 4 || len > 0x7fffffff)
+      return nullptr;
+
+    stbi__context s;
+    stbi__start_mem(&s, buffer, (int)len);
+    s.img_n = 0; // make stbi__cleanup_jpeg safe
+
+    stbi__jpeg *j = (stbi__jpeg *)stbi__malloc(sizeof(stbi__jpeg));
+    if (!j)
+      return nullptr;
+    memset(j, 0, sizeof(stbi__jpeg));
+    j->s = &s;
+    stbi__setup_jpeg(j);
+
+    unsigned char *output = nullptr;
+    if (decodeImage(j))
+      output = convert(j, x, y, comp, req_comp, dst, dstSize);
+
+    stbi__cleanup_jpeg(j);
+    STBI_FREE(j);
+    return output;
+  }
+
+private:
+  unsigned active = 1; // threads used for the current image
+
+  // stbi__decode_jpeg_image restricted to a single baseline scan
+  bool decodeImage(stbi__jpeg *j) {
+    j->restart_interval = 0;
+    if (!stbi__decode_jpeg_header(j, STBI__SCAN_load))
+      return false;
+    if (j->progressive || (j->s->img_n != 1 && j->s->img_n != 3))
+      return false;
+    active = (size_t)j->s->img_x * j->s->img_y < minPixels ? 1 : threads;
+
+    bool scanned = false;
+    int m = stbi__get_marker(j);
+    while (!stbi__EOI(m)) {
+      if (stbi__SOS(m)) {
+        if (scanned || !stbi__process_scan_header(j) ||
+            j->scan_n != j->s->img_n || !decodeScan(j))
+          return false;
+        scanned = true;
+        m = stbi__get_marker(j);
+        if (STBI__RESTART(m))
+          m = stbi__get_marker(j);
+      } else if (stbi__DNL(m)) {
+        int Ld = stbi__get16be(j->s);
+        stbi__uint32 NL = stbi__get16be(j->s);
+        if (Ld != 4 || NL != j->s->img_y)
+          return false;
+        m = stbi__get_marker(j);
+      } else {
+        if (!stbi__process_marker(j, m))
+          break;
+        m = stbi__get_marker(j);
+      }
+    }
+    return scanned;
+  }
+
+  int totalMcus(stbi__jpeg *j) {
+    if (j->scan_n == 1) {
+      int n = j->order[0];
+      return ((j->img_comp[n].x + 7) >> 3) * ((j->img_comp[n].y + 7) >> 3);
+    }
+    return j->img_mcu_x * j->img_mcu_y;
+  }
+
+  bool decodeScan(stbi__jpeg *j) {
+    // split the entropy coded data at RSTn markers; the last cut is the
+    // marker that ends the scan
+    const stbi_uc *start = j->s->img_buffer, *end = j->s->img_buffer_end;
+    std::vector<const stbi_uc *> cuts{start};
+    const stbi_uc *p = start, *stop = end;
+    while ((p = (const stbi_uc *)memchr(p, 0xff, end - p))) {
+      const stbi_uc *q = p + 1;
+      while (q < end && *q == 0xff)
+        q++;
+      if (q >= end)
+        break;
+      if (*q == 0x00) {
+        p = q + 1;
+      } else if (STBI__RESTART(*q)) {
+        p = q + 1;
+        cuts.push_back(p);
+      } else {
+        stop = p;
+        break;
+      }
+    }
+    cuts.push_back(stop);
+
+    const int mcus = totalMcus(j);
+    const int segments = (int)cuts.size() - 1;
+    const int interval = j->restart_interval ? j->restart_interval : mcus;
+    if (segments != (mcus + interval - 1) / interval)
+      return false;
+
+    // with a single segment there is nothing to run concurrently, so park
+    // the coefficients and parallelise the IDCT afterwards instead
+    const bool deferIdct = segments == 1 && active > 1;
+    if (deferIdct && !allocateCoefficients(j))
+      return false;
+
+    std::atomic<bool> ok{true};
+    parallel_for(segments, active, [&](int first, int last) {
+      stbi__jpeg w = *j;
+      stbi__context ctx;
+      for (int seg = first; seg < last && ok; seg++) {
+        stbi__start_mem(&ctx, cuts[seg], (int)(cuts[seg + 1] - cuts[seg]));
+        w.s = &ctx;
+        stbi__jpeg_reset(&w);
+        int m1 = std::min(mcus, (seg + 1) * interval);
+        for (int mcu = seg * interval; mcu < m1; mcu++) {
+          if (!decodeMcu(&w, mcu, deferIdct)) {
+            ok = false;
+            break;
+          }
+        }
+      }
+    });
+    if (!ok)
+      return false;
+
+    if (deferIdct)
+      idct(j);
+
+    // resume marker parsing after the scan
+    j->s->img_buffer = (stbi_uc *)stop;
+    j->marker = STBI__MARKER_none;
+    return true;
+  }
+
+  bool allocateCoefficients(stbi__jpeg *j) {
+    for (int n = 0; n < j->s->img_n; n++) {
+      auto &c = j->img_comp[n];
+      c.coeff_w = c.w2 / 8;
+      c.coeff_h = c.h2 / 8;
+      c.raw_coeff = stbi__malloc_mad3(c.w2, c.h2, sizeof(short), 15);
+      if (!c.raw_coeff)
+        return false;
+      c.coeff = (short *)(((size_t)c.raw_coeff + 15) & ~15);
+    }
+    return true;
+  }
+
+  bool decodeMcu(stbi__jpeg *w, int mcu, bool deferIdct) {
+    if (w->scan_n == 1) {
+      int n = w->order[0];
+      int bw = (w->img_comp[n].x + 7) >> 3;
+      return decodeBlock(w, n, mcu % bw, mcu / bw, deferIdct);
+    }
+    int i = mcu % w->img_mcu_x, row = mcu / w->img_mcu_x;
+    for (int k = 0; k < w->scan_n; k++) {
+      int n = w->order[k];
+      for (int y = 0; y < w->img_comp[n].v; y++)
+        for (int x = 0; x < w->img_comp[n].h; x++)
+          if (!decodeBlock(w, n, i * w->img_comp[n].h + x,
+                           row * w->img_comp[n].v + y, deferIdct))
+            return false;
+    }
+    return true;
+  }
+
+  bool decodeBlock(stbi__jpeg *w, int n, int bx, int by, bool deferIdct) {
+    STBI_SIMD_ALIGN(short, data[64]);
+    auto &c = w->img_comp[n];
+    short *dst = deferIdct ? c.coeff + 64 * (bx + by * c.coeff_w) : data;
+    int ha = c.ha;
+    if (!stbi__jpeg_decode_block(w, dst, w->huff_dc + c.hd, w->huff_ac + ha,
+                                 w->fast_ac[ha], n, w->dequant[c.tq]))
+      return false;
+    if (!deferIdct)
+      w->idct_block_kernel(c.data + c.w2 * by * 8 + bx * 8, c.w2, dst);
+    return true;
+  }
+
+  // parallel over MCU rows (block rows for a single component scan)
+  void idct(stbi__jpeg *j) {
+    const bool interleaved = j->scan_n > 1;
+    const int rows = interleaved ? j->img_mcu_y
+                                 : (j->img_comp[j->order[0]].y + 7) >> 3;
+    parallel_for(rows, active, [&](int first, int last) {
+      for (int k = 0; k < j->scan_n; k++) {
+        auto &c = j->img_comp[j->order[k]];
+        int per = interleaved ? c.v : 1;
+        int cols = interleaved ? j->img_mcu_x * c.h : (c.x + 7) >> 3;
+        for (int by = first * per; by < last * per; by++)
+          for (int bx = 0; bx < cols; bx++)
+            j->idct_block_kernel(c.data + c.w2 * by * 8 + bx * 8, c.w2,
+                                 c.coeff + 64 * (bx + by * c.coeff_w));
+      }
+    });
+  }
+
+  // the resample/colour conversion half of stb's load_jpeg_image, with the
+  // per-component resampler state fast-forwarded to the start of each band
+  unsigned char *convert(stbi__jpeg *z, int *out_x, int *out_y, int *comp,
+                         int req_comp, unsigned char *dst, size_t dstSize) {
+    const int img_n = z->s->img_n;
+    const unsigned img_x = z->s->img_x, img_y = z->s->img_y;
+    const int n = req_comp ? req_comp : img_n >= 3 ? 3 : 1;
+    const bool is_rgb =
+        img_n == 3 &&
+        (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+    const int decode_n = (img_n == 3 && n < 3 && !is_rgb) ? 1 : img_n;
+
+    if (dst && dstSize < (size_t)n * img_x * img_y)
+      return nullptr;
+    stbi_uc *output =
+        dst ? dst : (stbi_uc *)stbi__malloc_mad3(n, img_x, img_y, 1);
+    if (!output)
+      return nullptr;
+
+    const int bands = (int)std::max(1u, std::min<unsigned>(active, img_y));
+    // one line buffer per component per band, plus a spill row per band:
+    // stb's 3 channel converters store a byte past the end of the row, which
+    // would land in the next band's first pixel
+    std::vector<stbi_uc *> linebufs(bands * (decode_n + 1));
+    for (auto &buf : linebufs)
+      if (!(buf = (stbi_uc *)stbi__malloc(img_x * 4 + 3))) {
+        for (auto b : linebufs)
+          STBI_FREE(b);
+        if (!dst)
+          STBI_FREE(output);
+        return nullptr;
+      }
+
+    parallel_for(bands, bands, [&](int firstBand, int lastBand) {
+      for (int band = firstBand; band < lastBand; band++) {
+        const unsigned r0 = (unsigned)((size_t)img_y * band / bands);
+        const unsigned r1 = (unsigned)((size_t)img_y * (band + 1) / bands);
+
+        stbi__resample res_comp[4];
+        stbi_uc *coutput[4] = {NULL, NULL, NULL, NULL};
+        for (int k = 0; k < decode_n; ++k) {
+          stbi__resample *r = &res_comp[k];
+          auto &c = z->img_comp[k];
+          r->hs = z->img_h_max / c.h;
+          r->vs = z->img_v_max / c.v;
+          r->w_lores = (img_x + r->hs - 1) / r->hs;
+
+          int t = (r->vs >> 1) + (int)r0, wraps = t / r->vs;
+          r->ystep = t % r->vs;
+          r->ypos = wraps;
+          r->line1 = c.data + c.w2 * std::min(wraps, c.y - 1);
+          r->line0 =
+              wraps ? c.data + c.w2 * std::min(wraps - 1, c.y - 1) : c.data;
+
+          // clang-format off
+          if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+          else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
+          else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
+          else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
+          else                               r->resample = stbi__resample_row_generic;
+          // clang-format on
+        }
+
+        for (unsigned j = r0; j < r1; ++j) {
+          stbi_uc *out = output + (size_t)n * img_x * j;
+          for (int k = 0; k < decode_n; ++k) {
+            stbi__resample *r = &res_comp[k];
+            int y_bot = r->ystep >= (r->vs >> 1);
+            coutput[k] = r->resample(linebufs[band * (decode_n + 1) + k],
+                                     y_bot ? r->line1 : r->line0,
+                                     y_bot ? r->line0 : r->line1,
+                                     r->w_lores, r->hs);
+            if (++r->ystep >= r->vs) {
+              r->ystep = 0;
+              r->line0 = r->line1;
+              if (++r->ypos < z->img_comp[k].y)
+                r->line1 += z->img_comp[k].w2;
+            }
+          }
+          // caller memory has no slack after the last row either
+          if (j + 1 == r1 && (band + 1 < bands || dst)) {
+            stbi_uc *spill = linebufs[band * (decode_n + 1) + decode_n];
+            convertRow(z, spill, coutput, n, is_rgb);
+            memcpy(out, spill, (size_t)n * img_x);
+          } else {
+            convertRow(z, out, coutput, n, is_rgb);
+          }
+        }
+      }
+    });
+
+    for (auto b : linebufs)
+      STBI_FREE(b);
+
+    *out_x = img_x;
+    *out_y = img_y;
+    if (comp)
+      *comp = img_n >= 3 ? 3 : 1;
+    return output;
+  }
+
+  // the img_n 1 and 3 cases of load_jpeg_image
+  static void convertRow(stbi__jpeg *z, stbi_uc *out, stbi_uc **coutput,
+                         int n, bool is_rgb) {
+    const unsigned img_x = z->s->img_x;
+    stbi_uc *y = coutput[0];
+    if (n >= 3) {
+      if (z->s->img_n == 3) {
+        if (is_rgb) {
+          for (unsigned i = 0; i < img_x; ++i, out += n) {
+            out[0] = y[i];
+            out[1] = coutput[1][i];
+            out[2] = coutput[2][i];
+            if (n == 4)
+              out[3] = 255;
+          }
+        } else {
+          z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], img_x, n);
+        }
+      } else {
+        for (unsigned i = 0; i < img_x; ++i, out += n) {
+          out[0] = out[1] = out[2] = y[i];
+          if (n == 4)
+            out[3] = 255;
+        }
+      }
+    } else if (is_rgb) {
+      for (unsigned i = 0; i < img_x; ++i, out += n) {
+        out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+        if (n == 2)
+          out[1] = 255;
+      }
+    } else if (n == 1) {
+      memcpy(out, y, img_x);
+    } else {
+      for (unsigned i = 0; i < img_x; ++i, out += 2) {
+        out[0] = y[i];
+        out[1] = 255;
+      }
+    }
+  }
+};
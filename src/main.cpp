@@ -1,38 +1,87 @@
 #include <cmath>
 #include <glad/glad.h>
 
+#include "bloom.hpp"
 #include "debug.hpp"
+#include "dynamic_resolution.hpp"
+#include "fixed_timestep.hpp"
+#include "frame_capture.hpp"
+#include "frame_pacer.hpp"
+#include "gl_ext.hpp"
+#include "gpu_timer.hpp"
+#include "input.hpp"
+#include "occlusion.hpp"
+#include "post_chain.hpp"
+#include "render_graph.hpp"
 #include "shader.hpp"
+#include "shader_library.hpp"
 #include "texture.hpp"
+#include "texture_streamer.hpp"
+#include "triple_buffer.hpp"
+#include "uniform_buffer.hpp"
 
 #include <GLFW/glfw3.h>
 
-void key_callback(GLFWwindow *window, int key, int scancode, int action,
-                  int mods) {
-  if (key == GLFW_KEY_Q && action == GLFW_PRESS) {
-    glfwSetWindowShouldClose(window, GLFW_TRUE);
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <functional>
+#include <thread>
+
+// sampler uniforms of shader.frag, and the quad position in shader.vert
+static const UniformId u_tex0("tex0"), u_tex1("tex1"), u_offset("offset");
+// sharpen.frag, the upscale to the window
+static const UniformId u_source("source"), u_sharpness("sharpness");
+// the post-processing effects, see post.frag
+static const UniformId u_blur_direction("blurDirection"),
+    u_exposure("tonemapExposure"), u_contrast("gradeContrast"),
+    u_saturation("gradeSaturation"), u_grade_tint("gradeTint");
+
+void do_textures() {}
+
+// The simulated scene: the quad drifting around and bouncing off the edges
+// of the window.
+struct QuadState {
+  glsl::vec2 position = {0.0f, 0.0f};
+  glsl::vec2 velocity = {0.35f, 0.25f};
+};
+
+void simulate(QuadState &quad, float dt) {
+  quad.position.x += quad.velocity.x * dt;
+  quad.position.y += quad.velocity.y * dt;
+
+  // the quad is one unit across, so its centre stays within +-0.5
+  if (std::fabs(quad.position.x) > 0.5f) {
+    quad.position.x = std::copysign(0.5f, quad.position.x);
+    quad.velocity.x = -quad.velocity.x;
+  }
+  if (std::fabs(quad.position.y) > 0.5f) {
+    quad.position.y = std::copysign(0.5f, quad.position.y);
+    quad.velocity.y = -quad.velocity.y;
   }
 }
 
-void framebuffer_size_callback(GLFWwindow *window, int height, int width) {
-  glViewport(0, 0, width, height);
+// where to draw the quad alpha of the way from one step to the next
+glsl::vec2 interpolate(const QuadState &from, const QuadState &to,
+                       float alpha) {
+  return {from.position.x + (to.position.x - from.position.x) * alpha,
+          from.position.y + (to.position.y - from.position.y) * alpha};
 }
 
-void do_textures() {}
-
 unsigned int triangle_vao() {
   // Setup the vertex array object
   unsigned int VAO;
   glGenVertexArrays(1, &VAO);
   glBindVertexArray(VAO);
 
-  // First a vertex buffer to store the vertices
+  // First a vertex buffer to store the vertices. Texture rows are uploaded
+  // top-down as decoded, so v = 0 is the top edge of the image.
   float vertices[] = {
       // clang-format off
-	  -0.5f, 0.5f,  0.0f,   1.0f, 0.0f, 0.0f,   0.0f, 1.0f, // top left
-	  0.5f,  0.5f,  0.0f,   0.0f, 1.0f, 0.0f,   1.0f, 1.0f, // top-right
-	  0.5f,  -0.5f, 0.0f,   0.0f, 0.0f, 1.0f,   1.0f, 0.0f, // bottom-right
-	  -0.5f, -0.5f, 0.0f,   0.0f, 0.0f, 0.0f,	0.0f, 0.0f, // bottom-left
+	  -0.5f, 0.5f,  0.0f,   1.0f, 0.0f, 0.0f,   0.0f, 0.0f, // top left
+	  0.5f,  0.5f,  0.0f,   0.0f, 1.0f, 0.0f,   1.0f, 0.0f, // top-right
+	  0.5f,  -0.5f, 0.0f,   0.0f, 0.0f, 1.0f,   1.0f, 1.0f, // bottom-right
+	  -0.5f, -0.5f, 0.0f,   0.0f, 0.0f, 0.0f,	0.0f, 1.0f, // bottom-left
       // clang-format on
   };
   unsigned int VBO;
@@ -68,6 +117,298 @@ unsigned int triangle_vao() {
   return VAO;
 }
 
+// What the main thread hands the render thread after each round of events
+// and simulation steps.
+struct FrameSnapshot {
+  QuadState previous, current;
+  double currentTime = 0; // glfwGetTime() at which current became due
+  double step = 0;        // simulation step length
+  int width = 0, height = 0; // framebuffer size
+  bool vertexColor = false;
+  PresentMode presentMode = PresentMode::VSync;
+  int screenshots = 0; // bumped for each one wanted
+  bool recording = false;
+  bool dynamicResolution = true;
+  bool sharpen = true; // when upscaling, else a bilinear blit
+  bool blur = false;
+};
+
+// e.g. "screenshot-20240131-120000.png", in the working directory
+std::string capture_name(const char *prefix, const char *extension) {
+  char stamp[32];
+  std::time_t now = std::time(nullptr);
+  std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+  return std::string(prefix) + "-" + stamp + extension;
+}
+
+// Loads everything, then draws the newest snapshot every frame until running
+// is cleared, at whatever rate the pacer allows. The context must be current
+// until this returns, the GL objects it owns are deleted on the way out.
+void render(GLFWwindow *window, TripleBuffer<FrameSnapshot> &frames,
+            const std::atomic<bool> &running) {
+  frames.acquire();
+  int width = frames.read().width, height = frames.read().height;
+  RenderGraph graph;
+  graph.resize(width, height);
+
+  // Configure shaders; they compile while the textures load below. Run with
+  // ASSETS_DIR=../src and saving a source file relinks its program in place
+  ShaderLibrary shaders;
+  Shader &shader =
+      shaders.load("shaders/shader.vert", "shaders/shader.frag",
+                   [](Shader &s) {
+                     s.set(u_tex0, 0);
+                     s.set(u_tex1, 1);
+                   });
+  Shader &tinted = shaders.variant(shader, {"VERTEX_COLOR"});
+  Shader &sharpen =
+      shaders.load("shaders/fullscreen.vert", "shaders/sharpen.frag",
+                   [](Shader &s) { s.set(u_source, 0); });
+
+  // Get the triangle VAO
+  unsigned int vao_default = 0;
+  unsigned int vao_rect = triangle_vao();
+  // fullscreen.vert needs no attributes, but core profile needs a VAO
+  unsigned int vao_fullscreen;
+  glGenVertexArrays(1, &vao_fullscreen);
+
+  // a soft focus (off until B), then tone mapping and grading, which fuse
+  // into the blur's second pass, and FXAA on the result
+  PostChain post(shaders, vao_fullscreen);
+  PostChain::Effect &blur_x = post.add("blur", true, [](Shader &s) {
+    s.set(u_blur_direction, glsl::vec2{1.0f, 0.0f});
+  });
+  PostChain::Effect &blur_y = post.add("blur", true, [](Shader &s) {
+    s.set(u_blur_direction, glsl::vec2{0.0f, 1.0f});
+  });
+  blur_x.enabled = blur_y.enabled = false;
+  post.add("tonemap", false, [](Shader &s) { s.set(u_exposure, 1.0f); });
+  post.add("grade", false, [](Shader &s) {
+    s.set(u_contrast, 1.05f);
+    s.set(u_saturation, 1.1f);
+    s.set(u_grade_tint, glsl::vec3{1.0f, 0.98f, 0.95f});
+  });
+  post.add("fxaa", true);
+  post.precompile();
+
+  // glow from a five level pyramid, timed per level; P logs the timings
+  Bloom bloom(shaders, vao_fullscreen, 5);
+
+  // load the textures keeping only their low mips, on the GPU and the CPU;
+  // the streamer decodes them again to refine them up to the size the quad
+  // is drawn at, requested below whenever that changes
+  TextureStreamer streamer(64 << 20);
+  StreamedTexture &texture1 = streamer.load("textures/hammy.jpg");
+  StreamedTexture &texture2 = streamer.load("textures/wall.jpg");
+  int quad_pixels = 0;
+
+  // per-frame and per-material uniform blocks, written once per frame
+  UniformRing uniforms(4 << 10);
+  MaterialUniforms quad_material = {{1.0f, 1.0f, 1.0f, 1.0f}, 0.5f};
+  double last_time = glfwGetTime();
+
+  shaders.finish();
+
+  // the jitter of each present mode is logged when leaving it
+  FramePacer pacer(frames.read().presentMode, 144.0);
+  FrameCapture capture;
+  int screenshots = frames.read().screenshots;
+
+  // the scene, bloom and post-processing render at a fraction of the window
+  // size that keeps their GPU time, from the start of the scene pass to the
+  // end of the last post pass, within 10 ms
+  GpuTimer scaled_timer;
+  long long scaled_sample = 0; // the last measurement fed to resolution
+  DynamicResolution resolution(10.0, 0.5f, 1.0f);
+
+  // objects are tested against the scene's depth before they are drawn;
+  // P logs how many were culled
+  OcclusionCuller occlusion(shaders, vao_fullscreen);
+  int quad_object = occlusion.add();
+
+  while (running.load(std::memory_order_relaxed)) {
+    frames.acquire();
+    const FrameSnapshot &frame = frames.read();
+
+    if (frame.width != width || frame.height != height) {
+      width = frame.width;
+      height = frame.height;
+      graph.resize(width, height);
+    }
+    if (frame.presentMode != pacer.presentMode()) {
+      FramePacer::Stats stats = pacer.stats();
+      DBG("FRAME::PACING " << FramePacer::name(pacer.presentMode()) << " "
+                           << stats.meanMs << " ms, jitter " << stats.jitterMs
+                           << " ms, " << stats.minMs << "-" << stats.maxMs
+                           << " ms over " << stats.frames << " frames");
+      pacer.setMode(frame.presentMode, 144.0);
+      bloom.logTimings();
+      occlusion.logStats();
+    }
+    if (frame.screenshots != screenshots) {
+      screenshots = frame.screenshots;
+      capture.screenshot(capture_name("screenshot", ".png"));
+    }
+    if (frame.recording != capture.recording()) {
+      if (frame.recording)
+        capture.startRecording(capture_name("capture", ".y4m"), 60);
+      else
+        capture.stopRecording();
+    }
+
+    // each measurement once, and none of those still in flight when the
+    // scale last changed, which timed the old size
+    if (frame.dynamicResolution) {
+      if (scaled_timer.sample() > scaled_sample) {
+        scaled_sample = scaled_timer.sample();
+        if (resolution.update(scaled_timer.milliseconds())) {
+          scaled_sample = scaled_timer.issuedPairs();
+          DBG("RESOLUTION::SCALE " << resolution.scale() << " at "
+                                   << resolution.gpuMs() << " ms");
+        }
+      }
+    } else if (resolution.scale() != resolution.maxScale) {
+      resolution.reset();
+    }
+
+    shaders.update();
+    streamer.update();
+
+    // draw one step behind the simulation, between its last two states; if
+    // the main thread is late the quad holds at the newest one
+    double time = glfwGetTime();
+    float alpha = frame.step > 0
+                      ? (float)((time - frame.currentTime) / frame.step)
+                      : 1.0f;
+    glsl::vec2 offset = interpolate(frame.previous, frame.current,
+                                    std::min(std::max(alpha, 0.0f), 1.0f));
+
+    // the scene, its bloom and post-processing are drawn off screen at the
+    // dynamic scale, then upscaled to the window
+    graph.begin();
+    RenderTargetDesc scene_desc = {GL_RGBA16F, resolution.scale()};
+    RenderGraph::Resource scene_color = graph.create("scene", scene_desc);
+    int scene_width = graph.width(scene_color);
+    int scene_height = graph.height(scene_color);
+
+    // the quad is half the scene across, in scene pixels
+    if (std::max(scene_width, scene_height) / 2 != quad_pixels) {
+      quad_pixels = std::max(scene_width, scene_height) / 2;
+      texture1.request(quad_pixels);
+      texture2.request(quad_pixels);
+    }
+    RenderGraph::Resource scene_depth = graph.create(
+        "scene depth", {GL_DEPTH_COMPONENT24, resolution.scale()});
+
+    uniforms.beginFrame();
+    UniformSlot frame_block = uniforms.push(FrameUniforms{
+        {(float)scene_width, (float)scene_height}, (float)time,
+        (float)(time - last_time)});
+    UniformSlot material = uniforms.push(quad_material);
+    uniforms.upload();
+    last_time = time;
+
+    graph.addPass("scene")
+        .write(scene_color)
+        .write(scene_depth)
+        .execute([&](RenderGraph &) {
+          scaled_timer.begin();
+          glClearColor(.2f, 0.0f, .2f, 1.0f);
+          glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+          glEnable(GL_DEPTH_TEST);
+
+          // bind textures on corresponding texture units
+          texture1.use(GL_TEXTURE0);
+          texture2.use(GL_TEXTURE1);
+
+          uniforms.bind(UniformBinding::Frame, frame_block);
+          uniforms.bind(UniformBinding::Material, material);
+          Shader &active = frame.vertexColor ? tinted : shader;
+
+          // the quad spans one unit around its offset, flat at z = 0
+          OcclusionCuller::Box quad_box = {
+              {offset.x - 0.5f, offset.y - 0.5f, 0.0f},
+              {offset.x + 0.5f, offset.y + 0.5f, 0.0f}};
+          occlusion.submit(quad_object, quad_box, [&] {
+            active.use();
+            active.set(u_offset, offset);
+
+            glBindVertexArray(vao_rect);
+            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+            // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+            // glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+            // re-bind the default vertex array
+            glBindVertexArray(vao_default);
+          });
+          occlusion.flush();
+
+          glDisable(GL_DEPTH_TEST);
+        });
+
+    blur_x.enabled = blur_y.enabled = frame.blur;
+    RenderGraph::Resource lit = bloom.addTo(graph, scene_color, scene_desc);
+    RenderGraph::Resource image = post.addTo(graph, lit, scene_desc);
+
+    graph.addPass("present")
+        .read(image)
+        .write(graph.backbuffer())
+        .execute([&](RenderGraph &g) {
+          // everything before this pass ran at the scaled size
+          scaled_timer.end();
+          bool upscaling = scene_width < width || scene_height < height;
+          if (frame.sharpen && upscaling && sharpen.ready()) {
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, g.texture(image));
+            glBindSampler(0, 0);
+            sharpen.use();
+            sharpen.set(u_sharpness, 0.25f);
+            glBindVertexArray(vao_fullscreen);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glBindVertexArray(vao_default);
+          } else {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, g.framebuffer(image));
+            glBlitFramebuffer(0, 0, scene_width, scene_height, 0, 0, width,
+                              height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+          }
+        });
+
+    // the frame as presented, so a recording keeps one size while the
+    // scene's changes
+    if (capture.wanted())
+      graph.addPass("capture")
+          .read(graph.backbuffer())
+          .sideEffect()
+          .execute([&](RenderGraph &) { capture.capture(0, width, height); });
+
+    graph.compile();
+    graph.execute();
+    uniforms.endFrame();
+    capture.update();
+
+    pacer.wait();
+    glfwSwapBuffers(window);
+    pacer.presented();
+  }
+}
+
+// Owns the GL context for as long as render() runs.
+void render_loop(GLFWwindow *window, TripleBuffer<FrameSnapshot> &frames,
+                 const std::atomic<bool> &running) {
+  glfwMakeContextCurrent(window);
+
+  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+    DBG("Failed to load GLAD");
+    glfwSetWindowShouldClose(window, GLFW_TRUE);
+    glfwPostEmptyEvent();
+    return;
+  }
+  GLExt::load((GLADloadproc)glfwGetProcAddress);
+
+  render(window, frames, running);
+  glfwMakeContextCurrent(NULL);
+}
+
 int main() {
   int height = 800, width = 800;
 
@@ -83,111 +424,89 @@ int main() {
     return -1;
   }
 
-  glfwMakeContextCurrent(window);
-
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-    DBG("Failed to load GLAD");
-    return -1;
-  }
-
-  glViewport(0, 0, width, height);
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-  glfwSetKeyCallback(window, key_callback);
+  // Q quits, C toggles the VERTEX_COLOR variant, P moves on to the next
+  // present mode, F12 takes a screenshot, F9 starts or stops recording, F10
+  // toggles dynamic resolution, F11 sharpening when upscaling and B the
+  // soft focus
+  Input input(window);
+  bool vertex_color = false;
+  int screenshots = 0;
+  bool recording = false;
+  bool dynamic_resolution = true, sharpen = true, blur = false;
 
-  // Configure shaders
-  Shader shader("../src/shaders/shader.vert", "../src/shaders/shader.frag");
+  // the simulation runs at 120 Hz on this thread, which also pumps the
+  // window events; the render thread draws between the last two steps
+  FixedTimestep timestep(1.0 / 120.0);
+  QuadState previous, current;
+  PresentMode present_mode = PresentMode::VSync;
 
-  // Get the triangle VAO
-  unsigned int vao_default = 0;
-  unsigned int vao_rect = triangle_vao();
+  TripleBuffer<FrameSnapshot> frames;
+  auto publish = [&](double now) {
+    FrameSnapshot &frame = frames.write();
+    frame.previous = previous;
+    frame.current = current;
+    frame.currentTime = now - timestep.alpha() * timestep.step;
+    frame.step = timestep.step;
+    frame.width = input.state().width;
+    frame.height = input.state().height;
+    frame.vertexColor = vertex_color;
+    frame.presentMode = present_mode;
+    frame.screenshots = screenshots;
+    frame.recording = recording;
+    frame.dynamicResolution = dynamic_resolution;
+    frame.sharpen = sharpen;
+    frame.blur = blur;
+    frames.publish();
+  };
 
-  // load and create a texture
-  // -------------------------
-  unsigned int texture1, texture2;
-  // texture 1
-  // ---------
-  glGenTextures(1, &texture1);
-  glBindTexture(GL_TEXTURE_2D, texture1);
-  // set the texture wrapping parameters
-  glTexParameteri(
-      GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
-      GL_REPEAT); // set texture wrapping to GL_REPEAT (default wrapping method)
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  // set texture filtering parameters
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  // load image, create texture and generate mipmaps
-  int t_width, t_height, nrChannels;
-  stbi_set_flip_vertically_on_load(
-      true); // tell stb_image.h to flip loaded texture's on the y-axis.
-  // The FileSystem::getPath(...) is part of the GitHub repository so we can
-  // find files on any IDE/platform; replace it with your own image path.
-  unsigned char *data =
-      stbi_load("../src/textures/hammy.jpg", &t_width, &t_height, &nrChannels, 0);
-  if (data) {
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, t_width, t_height, 0, GL_RGB,
-                 GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-  } else {
-    std::cout << "Failed to load texture" << std::endl;
-  }
-  stbi_image_free(data);
-  // texture 2
-  // ---------
-  glGenTextures(1, &texture2);
-  glBindTexture(GL_TEXTURE_2D, texture2);
-  // set the texture wrapping parameters
-  glTexParameteri(
-      GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
-      GL_REPEAT); // set texture wrapping to GL_REPEAT (default wrapping method)
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  // set texture filtering parameters
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  // load image, create texture and generate mipmaps
-  data = stbi_load("../src/textures/wall.jpg", &t_width, &t_height, &nrChannels, 0);
-  if (data) {
-    // note that the awesomeface.png has transparency and thus an alpha channel,
-    // so make sure to tell OpenGL the data type is of GL_RGBA
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, t_width, t_height, 0, GL_RGBA,
-                 GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-  } else {
-    std::cout << "Failed to load texture" << std::endl;
-  }
-  stbi_image_free(data);
+  double last_time = glfwGetTime();
+  publish(last_time);
 
-  shader.use();
-  shader.setInt("tex0", 0);
-  shader.setInt("tex1", 1);
+  std::atomic<bool> running{true};
+  std::thread renderer(render_loop, window, std::ref(frames),
+                       std::cref(running));
 
   while (!glfwWindowShouldClose(window)) {
-    glClearColor(.2f, 0.0f, .2f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture1);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, texture2);
+    // sleep until input arrives or the next step is due
+    glfwWaitEventsTimeout((1.0 - timestep.alpha()) * timestep.step);
+    input.update();
+    const InputState &keys = input.state();
 
-    // set the shader green value
-    // float time = glfwGetTime();
-    float time = 0;
-    shader.use();
+    if (keys.wasPressed(GLFW_KEY_Q))
+      glfwSetWindowShouldClose(window, GLFW_TRUE);
+    if (keys.wasPressed(GLFW_KEY_C))
+      vertex_color = !vertex_color;
+    if (keys.wasPressed(GLFW_KEY_F12))
+      screenshots++;
+    if (keys.wasPressed(GLFW_KEY_F9))
+      recording = !recording;
+    if (keys.wasPressed(GLFW_KEY_F10))
+      dynamic_resolution = !dynamic_resolution;
+    if (keys.wasPressed(GLFW_KEY_F11))
+      sharpen = !sharpen;
+    if (keys.wasPressed(GLFW_KEY_B))
+      blur = !blur;
+    if (keys.wasPressed(GLFW_KEY_P)) {
+      present_mode = PresentMode(((int)present_mode + 1) % 4);
 
-    glBindVertexArray(vao_rect);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-    // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    // glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+      const FixedTimestep::Stats &sim = timestep.statistics();
+      DBG("SIM::STEPS " << sim.meanSteps << " per frame, at most "
+                        << sim.maxSteps << ", " << sim.droppedSteps
+                        << " dropped");
+      timestep.resetStatistics();
+    }
 
-    // re-bind the default vertex array
-    glBindVertexArray(vao_default);
-
-    glfwPollEvents();
-    glfwSwapBuffers(window);
+    double now = glfwGetTime();
+    timestep.advance(now - last_time, [&](double dt) {
+      previous = current;
+      simulate(current, (float)dt);
+    });
+    last_time = now;
+    publish(now);
   }
 
+  running = false;
+  renderer.join();
   glfwTerminate();
 
   return 0;
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <functional>
+#include <vector>
+
+#include "debug.hpp"
+#include "shader.hpp"
+#include "shader_library.hpp"
+#include "shader_reflection.hpp"
+
+// Skips drawing objects hidden behind what is already in the depth buffer.
+// Draw the occluders first as usual, then submit() the other objects with
+// a bounding box and flush(). flush() draws every box under a
+// GL_ANY_SAMPLES_PASSED query, then each object inside a conditional
+// render on its box's query, so the GPU drops hidden ones itself. Results
+// are read back a frame later, only once available, so the CPU never
+// waits: an object found hidden is not even submitted, only its box is
+// tested again each frame, and it is drawn again the frame after that
+// test passes.
+class OcclusionCuller {
+public:
+  // corners in normalized device coordinates
+  struct Box {
+    glsl::vec3 min, max;
+  };
+  using Draw = std::function<void()>;
+
+  struct Stats {
+    int objects = 0;
+    int drawn = 0;  // submitted to the GPU, which may still have dropped them
+    int culled = 0; // hidden last frame, so only their box was drawn
+  };
+
+  bool enabled = true;
+
+  // vao is bound for the attribute-less box draws
+  OcclusionCuller(ShaderLibrary &library, unsigned int vao)
+      : vao(vao), boxShader(library.load("shaders/occlusion.vert",
+                                         "shaders/occlusion.frag")) {}
+
+  ~OcclusionCuller() {
+    for (Object &o : objects)
+      glDeleteQueries(QUERIES, o.queries);
+  }
+
+  OcclusionCuller(const OcclusionCuller &) = delete;
+  OcclusionCuller &operator=(const OcclusionCuller &) = delete;
+
+  // an id for an object that is tested from now on
+  int add() {
+    objects.emplace_back();
+    glGenQueries(QUERIES, objects.back().queries);
+    return (int)objects.size() - 1;
+  }
+
+  // Queues the object for this frame's flush(). draw runs at most once,
+  // inside flush(), and is skipped when the box was hidden last frame.
+  void submit(int object, const Box &box, Draw draw) {
+    queued.push_back({object, box, std::move(draw), 0});
+  }
+
+  // Call after the occluders are in the depth buffer, with depth testing
+  // on and the object's render state in place.
+  void flush() {
+    stats = Stats();
+    stats.objects = (int)queued.size();
+    if (!enabled || !boxShader.ready()) {
+      for (Queued &q : queued)
+        q.draw();
+      stats.drawn = stats.objects;
+      queued.clear();
+      return;
+    }
+
+    collect();
+
+    // the boxes, all in one state change: tested against depth, written
+    // nowhere
+    GLboolean depthMask;
+    glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+    GLint depthFunc;
+    glGetIntegerv(GL_DEPTH_FUNC, &depthFunc);
+    GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glDepthFunc(GL_LEQUAL);
+    glDisable(GL_CULL_FACE);
+    boxShader.use();
+    glBindVertexArray(vao);
+    for (Queued &q : queued) {
+      Object &o = objects[q.object];
+      // a query still in flight cannot be reused; the object goes untested
+      if (o.pending == QUERIES)
+        continue;
+      q.query = o.queries[(o.first + o.pending) % QUERIES];
+      o.pending++;
+      boxShader.set(u_box_min, q.box.min);
+      boxShader.set(u_box_max, q.box.max);
+      glBeginQuery(GL_ANY_SAMPLES_PASSED, q.query);
+      glDrawArrays(GL_TRIANGLES, 0, 36);
+      glEndQuery(GL_ANY_SAMPLES_PASSED);
+    }
+    glBindVertexArray(0);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(depthMask);
+    glDepthFunc(depthFunc);
+    if (cullFace)
+      glEnable(GL_CULL_FACE);
+
+    // Hidden last frame: skip, the box query above decides about the next.
+    // Otherwise draw, and let the GPU drop it if the box turned out hidden
+    // by now; without waiting, so a late result just means it is drawn.
+    for (Queued &q : queued) {
+      if (!objects[q.object].visible) {
+        stats.culled++;
+        continue;
+      }
+      stats.drawn++;
+      if (q.query)
+        glBeginConditionalRender(q.query, GL_QUERY_NO_WAIT);
+      q.draw();
+      if (q.query)
+        glEndConditionalRender();
+    }
+    queued.clear();
+  }
+
+  const Stats &statistics() const { return stats; }
+
+  void logStats() const {
+    DBG("OCCLUSION::STATS " << stats.objects << " objects, " << stats.drawn
+                            << " drawn, " << stats.culled << " culled");
+  }
+
+private:
+  static constexpr int QUERIES = 3; // per object, frames in flight
+
+  static inline const UniformId u_box_min{"boxMin"}, u_box_max{"boxMax"};
+
+  struct Object {
+    unsigned int queries[QUERIES];
+    int first = 0, pending = 0; // ring of issued queries
+    bool visible = true;        // as of the newest result read
+  };
+  struct Queued {
+    int object;
+    Box box;
+    Draw draw;
+    unsigned int query; // this frame's, 0 when none was free
+  };
+
+  unsigned int vao;
+  Shader &boxShader;
+  std::vector<Object> objects;
+  std::vector<Queued> queued;
+  Stats stats;
+
+  // takes in every result that is ready, oldest first, without waiting
+  void collect() {
+    for (Object &o : objects)
+      while (o.pending) {
+        unsigned int query = o.queries[o.first];
+        int available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+          break;
+        unsigned int passed = 0;
+        glGetQueryObjectuiv(query, GL_QUERY_RESULT, &passed);
+        o.visible = passed != 0;
+        o.first = (o.first + 1) % QUERIES;
+        o.pending--;
+      }
+  }
+};
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "render_graph.hpp"
+#include "shader.hpp"
+#include "shader_library.hpp"
+
+// Full-screen effects applied in order to the scene, each a GLSL function
+// in shaders/ that post.frag includes. Per-pixel effects,
+//   vec4 name(vec4 color)
+// are fused into the pass before them, so a run of them costs one
+// full-screen pass instead of one each. An effect that samples around the
+// pixel,
+//   vec4 name(sampler2D source, vec2 uv)
+// needs everything before it written out, so it starts a new pass. Each
+// pass reads the previous pass's target and writes a new one; the render
+// graph aliases those down to two textures that ping-pong. The programs
+// come from the library, one per distinct fused sequence, so they reload
+// with the rest.
+class PostChain {
+public:
+  // sets the effect's uniforms, with its pass's program bound
+  using Configure = std::function<void(Shader &)>;
+
+  struct Effect {
+    std::string function;
+    bool neighbourhood; // samples around the pixel
+    Configure configure;
+    bool enabled = true;
+  };
+
+  // vao is bound while drawing the fullscreen triangle, which needs no
+  // attributes
+  PostChain(ShaderLibrary &library, unsigned int vao)
+      : library(library), vao(vao) {}
+
+  PostChain(const PostChain &) = delete;
+  PostChain &operator=(const PostChain &) = delete;
+
+  // the reference stays valid, e.g. to toggle enabled
+  Effect &add(const std::string &function, bool neighbourhood,
+              Configure configure = nullptr) {
+    effects.push_back({function, neighbourhood, std::move(configure)});
+    return effects.back();
+  }
+
+  // Adds one graph pass per fused run of the enabled effects, reading input
+  // and writing targets of the given description. Returns the last of
+  // those, or input when no effect is enabled.
+  RenderGraph::Resource addTo(RenderGraph &graph, RenderGraph::Resource input,
+                              const RenderTargetDesc &desc) {
+    fuse();
+    RenderGraph::Resource current = input;
+    for (Pass &p : passes) {
+      p.input = current;
+      p.output = current = graph.create("post", desc);
+      graph.addPass("post " + name(p))
+          .read(p.input)
+          .write(p.output)
+          .execute([this, &p](RenderGraph &g) { draw(g, p); });
+    }
+    return current;
+  }
+
+  // full-screen passes the enabled effects took in the last addTo()
+  int passCount() const { return (int)passes.size(); }
+
+  // submits the programs the current settings need, so that finishing the
+  // library before the first frame covers them too
+  void precompile() { fuse(); }
+
+private:
+  struct Pass {
+    std::vector<const Effect *> effects;
+    Shader *shader = nullptr;
+    RenderGraph::Resource input = 0, output = 0;
+  };
+
+  ShaderLibrary &library;
+  unsigned int vao;
+  std::deque<Effect> effects;
+  std::deque<Pass> passes; // this frame's, referenced by the graph passes
+  std::map<std::string, Shader *> programs; // by their defines, joined
+
+  // splits the enabled effects into passes and finds their programs
+  void fuse() {
+    passes.clear();
+    for (const Effect &e : effects) {
+      if (!e.enabled)
+        continue;
+      // a function appears at most once per pass, its uniforms are shared
+      if (passes.empty() || e.neighbourhood || contains(passes.back(), e))
+        passes.emplace_back();
+      passes.back().effects.push_back(&e);
+    }
+    for (Pass &p : passes)
+      p.shader = &program(p);
+  }
+
+  static bool contains(const Pass &p, const Effect &e) {
+    for (const Effect *other : p.effects)
+      if (other->function == e.function)
+        return true;
+    return false;
+  }
+
+  static std::string name(const Pass &p) {
+    std::string out;
+    for (const Effect *e : p.effects)
+      out += (out.empty() ? "" : "+") + e->function;
+    return out;
+  }
+
+  // POST_SOURCE and POST_APPLY as post.frag expects them
+  Shader &program(const Pass &p) {
+    std::vector<std::string> defines;
+    size_t first = 0;
+    if (p.effects[0]->neighbourhood) {
+      defines.push_back("POST_SOURCE=" + p.effects[0]->function);
+      first = 1;
+    }
+    if (first < p.effects.size()) {
+      std::string apply = "c";
+      for (size_t i = first; i < p.effects.size(); i++)
+        apply = p.effects[i]->function + "(" + apply + ")";
+      defines.push_back("POST_APPLY(c)=" + apply);
+    }
+
+    std::string key;
+    for (const std::string &d : defines)
+      key += d + ";";
+    auto found = programs.find(key);
+    if (found != programs.end())
+      return *found->second;
+
+    static const UniformId source("source");
+    Shader &shader = library.load(
+        "shaders/fullscreen.vert", "shaders/post.frag",
+        [](Shader &s) { s.set(source, 0); }, std::move(defines));
+    return *(programs[key] = &shader);
+  }
+
+  void draw(RenderGraph &g, const Pass &p) {
+    // still compiling: pass the input through rather than show nothing
+    if (!p.shader->ready()) {
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, g.framebuffer(p.input));
+      glBlitFramebuffer(0, 0, g.width(p.input), g.height(p.input), 0, 0,
+                        g.width(p.output), g.height(p.output),
+                        GL_COLOR_BUFFER_BIT, GL_LINEAR);
+      return;
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, g.texture(p.input));
+    glBindSampler(0, 0);
+    p.shader->use();
+    for (const Effect *e : p.effects)
+      if (e->configure)
+        e->configure(*p.shader);
+    glBindVertexArray(vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+  }
+};
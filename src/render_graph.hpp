@@ -0,0 +1,463 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "debug.hpp"
+
+// A render target a graph allocates for the frame. Sized relative to the
+// framebuffer unless width and height are given. Colour and depth formats
+// only, integer formats cannot be allocated empty this way.
+struct RenderTargetDesc {
+  GLenum format = GL_RGBA8;
+  float scale = 1.0f;        // of the framebuffer size
+  int width = 0, height = 0; // fixed size, overrides scale
+
+  bool operator==(const RenderTargetDesc &o) const {
+    return format == o.format && scale == o.scale && width == o.width &&
+           height == o.height;
+  }
+};
+
+// The frame's passes, declared anew each frame with the targets they read
+// and write, then compiled and executed:
+//
+//   graph.begin();
+//   Resource color = graph.create("scene", {GL_RGBA8});
+//   graph.addPass("scene").write(color).execute([&](RenderGraph &g) {...});
+//   graph.addPass("present").read(color).write(graph.backbuffer())...;
+//   graph.compile();
+//   graph.execute();
+//
+// Passes run in the order they were added. A pass can only read what an
+// earlier pass wrote, so that order already respects every dependency.
+// compile() drops passes whose output nothing reads, unless they write the
+// backbuffer or are marked sideEffect(), then packs the targets: two whose
+// lifetimes do not overlap share one texture. Textures and framebuffers
+// outlive the frame, so after the first frame compiling allocates nothing.
+// On resize() or a change of scale a target is reallocated when it is next
+// used, and only when the size it resolves to changed.
+class RenderGraph {
+public:
+  using Resource = int;
+  using Execute = std::function<void(RenderGraph &)>;
+
+  class Pass {
+  public:
+    Pass &read(Resource r) {
+      reads.push_back(r);
+      return *this;
+    }
+    // several colour targets go to consecutive draw buffers, in order
+    Pass &write(Resource r) {
+      writes.push_back(r);
+      return *this;
+    }
+    Pass &sideEffect() {
+      keep = true;
+      return *this;
+    }
+    Pass &execute(Execute fn) {
+      run = std::move(fn);
+      return *this;
+    }
+
+  private:
+    friend class RenderGraph;
+    std::string name;
+    std::vector<Resource> reads, writes;
+    Execute run;
+    bool keep = false, live = false;
+    unsigned int fbo = 0;
+  };
+
+  RenderGraph() = default;
+  RenderGraph(const RenderGraph &) = delete;
+  RenderGraph &operator=(const RenderGraph &) = delete;
+
+  ~RenderGraph() {
+    for (auto &entry : framebuffers)
+      glDeleteFramebuffers(1, &entry.second);
+    for (Target &t : targets)
+      glDeleteTextures(1, &t.texture);
+  }
+
+  // framebuffer size; relative targets follow it lazily
+  void resize(int width, int height) {
+    fbWidth = width;
+    fbHeight = height;
+  }
+
+  // the default framebuffer, written by the pass that presents
+  Resource backbuffer() const { return 0; }
+
+  void begin() {
+    passes.clear();
+    resources.assign(1, ResourceInfo{"backbuffer", RenderTargetDesc()});
+    compiled = false;
+  }
+
+  Resource create(const std::string &name, const RenderTargetDesc &desc) {
+    resources.push_back(ResourceInfo{name, desc});
+    return (Resource)resources.size() - 1;
+  }
+
+  Pass &addPass(const std::string &name) {
+    passes.emplace_back();
+    passes.back().name = name;
+    return passes.back();
+  }
+
+  void compile() {
+    cull();
+    alias();
+    for (Pass &p : passes)
+      if (p.live)
+        p.fbo = passFramebuffer(p);
+    releaseUnused();
+    compiled = true;
+
+    int live = 0;
+    for (const Pass &p : passes)
+      live += p.live;
+    Summary summary = {live, (int)passes.size() - live, (int)targets.size()};
+    if (!(summary == lastSummary)) {
+      lastSummary = summary;
+      DBG("RENDERGRAPH::COMPILED " << live << " passes (" << summary.culled
+                                   << " culled), " << summary.targets
+                                   << " targets for "
+                                   << resources.size() - 1 << " resources, "
+                                   << allocatedBytes() / (1 << 20) << " MiB");
+    }
+  }
+
+  void execute() {
+    if (!compiled)
+      compile();
+    for (Pass &p : passes) {
+      if (!p.live)
+        continue;
+      for (Resource r : p.reads)
+        allocate(r);
+      for (Resource r : p.writes)
+        allocate(r);
+
+      if (!p.writes.empty()) {
+        glBindFramebuffer(GL_FRAMEBUFFER, p.fbo);
+        glViewport(0, 0, width(p.writes[0]), height(p.writes[0]));
+      }
+      if (p.run)
+        p.run(*this);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, fbWidth, fbHeight);
+  }
+
+  // the texture backing r this frame, 0 for the backbuffer or a culled r
+  unsigned int texture(Resource r) const {
+    int t = resources[r].target;
+    return t < 0 ? 0 : targets[t].texture;
+  }
+
+  int width(Resource r) const {
+    return r == 0 ? fbWidth : extent(resources[r].desc, fbWidth);
+  }
+  int height(Resource r) const {
+    return r == 0 ? fbHeight : extent(resources[r].desc, fbHeight, true);
+  }
+
+  // a framebuffer with only r attached, to blit or read back from; 0 for
+  // the backbuffer, and for a culled r
+  unsigned int framebuffer(Resource r) {
+    if (r == 0 || resources[r].target < 0)
+      return 0;
+    allocate(r);
+    return cachedFramebuffer({texture(r)}, {resources[r].desc.format});
+  }
+
+  size_t allocatedBytes() const {
+    size_t bytes = 0;
+    for (const Target &t : targets)
+      bytes += (size_t)t.width * t.height * bytesPerPixel(t.desc.format);
+    return bytes;
+  }
+
+private:
+  struct ResourceInfo {
+    std::string name;
+    RenderTargetDesc desc;
+    int target = -1;
+    int firstUse = -1, lastUse = -1; // live pass indices
+  };
+  struct Target {
+    unsigned int texture = 0;
+    RenderTargetDesc desc;
+    int width = 0, height = 0; // as allocated, 0 before
+    int busyUntil = -1;        // during alias(): last pass using it
+    int idleFrames = 0;
+  };
+  struct Summary {
+    int live = -1, culled = -1, targets = -1;
+    bool operator==(const Summary &o) const {
+      return live == o.live && culled == o.culled && targets == o.targets;
+    }
+  };
+
+  // targets nothing used for this many frames are freed
+  static constexpr int RELEASE_AFTER = 60;
+
+  std::deque<Pass> passes; // stable references for the fluent calls
+  std::vector<ResourceInfo> resources;
+  std::vector<Target> targets;
+  std::map<std::vector<unsigned int>, unsigned int> framebuffers;
+  int fbWidth = 0, fbHeight = 0;
+  bool compiled = false;
+  Summary lastSummary;
+
+  static int extent(const RenderTargetDesc &d, int fb, bool vertical = false) {
+    int fixed = vertical ? d.height : d.width;
+    if (fixed > 0)
+      return fixed;
+    return std::max(1, (int)std::lround(fb * d.scale));
+  }
+
+  static bool isDepth(GLenum format) {
+    return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 ||
+           format == GL_DEPTH_COMPONENT32F || isDepthStencil(format);
+  }
+  static bool isDepthStencil(GLenum format) {
+    return format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+  }
+
+  static int bytesPerPixel(GLenum format) {
+    switch (format) {
+    case GL_R8:
+      return 1;
+    case GL_RG8:
+    case GL_R16F:
+    case GL_DEPTH_COMPONENT16:
+      return 2;
+    case GL_RGBA16F:
+    case GL_RG32F:
+    case GL_DEPTH32F_STENCIL8:
+      return 8;
+    case GL_RGBA32F:
+      return 16;
+    default:
+      return 4;
+    }
+  }
+
+  // Walks back from the passes that must run, keeping the writers of
+  // whatever they read. A write that replaces a target without reading it
+  // ends the search for earlier writers of that target.
+  void cull() {
+    std::vector<bool> needed(resources.size(), false);
+    for (auto p = passes.rbegin(); p != passes.rend(); ++p) {
+      p->live = p->keep;
+      for (Resource r : p->writes)
+        if (r == 0 || needed[r])
+          p->live = true;
+      if (!p->live)
+        continue;
+      for (Resource r : p->writes)
+        if (std::find(p->reads.begin(), p->reads.end(), r) == p->reads.end())
+          needed[r] = false;
+      for (Resource r : p->reads)
+        needed[r] = true;
+    }
+
+    // reading something no live pass wrote samples garbage
+    std::vector<bool> written(resources.size(), false);
+    for (const Pass &p : passes) {
+      if (!p.live)
+        continue;
+      for (Resource r : p.reads)
+        if (r != 0 && !written[r])
+          DBG("RENDERGRAPH::UNWRITTEN " << p.name << " reads "
+                                        << resources[r].name
+                                        << " before anything writes it");
+      for (Resource r : p.writes)
+        written[r] = true;
+    }
+  }
+
+  // Greedy interval packing: in order of first use, each resource takes a
+  // texture of the same format that is free by then. One already the right
+  // size is preferred, then one this frame has not used yet, which is
+  // resized in place, so a change of scale reuses the textures rather than
+  // allocating a second set. Only when neither exists is a texture added.
+  void alias() {
+    for (ResourceInfo &res : resources)
+      res.firstUse = res.lastUse = -1;
+    int index = 0;
+    for (Pass &p : passes) {
+      if (!p.live)
+        continue;
+      for (const std::vector<Resource> *list : {&p.reads, &p.writes})
+        for (Resource r : *list) {
+          ResourceInfo &res = resources[r];
+          if (res.firstUse < 0)
+            res.firstUse = index;
+          res.lastUse = index;
+        }
+      index++;
+    }
+
+    std::vector<int> order;
+    for (int r = 1; r < (int)resources.size(); r++)
+      if (resources[r].firstUse >= 0)
+        order.push_back(r);
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+      return resources[a].firstUse < resources[b].firstUse;
+    });
+
+    for (Target &t : targets)
+      t.busyUntil = -1;
+    for (ResourceInfo &res : resources)
+      res.target = -1;
+    for (int r : order) {
+      ResourceInfo &res = resources[r];
+      int w = extent(res.desc, fbWidth), h = extent(res.desc, fbHeight, true);
+      for (int t = 0; t < (int)targets.size(); t++) {
+        const Target &c = targets[t];
+        if (c.desc.format != res.desc.format || c.busyUntil >= res.firstUse)
+          continue;
+        if (c.width == w && c.height == h) {
+          res.target = t;
+          break;
+        }
+        // a texture has one size per frame, so only an unused one resizes
+        if (res.target < 0 && c.busyUntil < 0)
+          res.target = t;
+      }
+      if (res.target >= 0) {
+        targets[res.target].desc = res.desc;
+      } else {
+        targets.emplace_back();
+        targets.back().desc = res.desc;
+        glGenTextures(1, &targets.back().texture);
+        res.target = (int)targets.size() - 1;
+      }
+      targets[res.target].busyUntil = res.lastUse;
+      allocate(r);
+    }
+  }
+
+  // (re)specifies the texture when it is new or the size it needs changed
+  void allocate(Resource r) {
+    if (r == 0 || resources[r].target < 0)
+      return;
+    Target &t = targets[resources[r].target];
+    int w = extent(t.desc, fbWidth), h = extent(t.desc, fbHeight, true);
+    if (t.width == w && t.height == h)
+      return;
+    t.width = w;
+    t.height = h;
+
+    GLenum format = GL_RGBA, type = GL_UNSIGNED_BYTE;
+    if (t.desc.format == GL_DEPTH24_STENCIL8) {
+      format = GL_DEPTH_STENCIL;
+      type = GL_UNSIGNED_INT_24_8;
+    } else if (t.desc.format == GL_DEPTH32F_STENCIL8) {
+      format = GL_DEPTH_STENCIL;
+      type = GL_FLOAT_32_UNSIGNED_INT_24_8_REV;
+    } else if (isDepth(t.desc.format)) {
+      format = GL_DEPTH_COMPONENT;
+      type = GL_FLOAT;
+    }
+
+    // attachments refer to the texture object, so framebuffers using it
+    // stay valid across the respecification
+    glBindTexture(GL_TEXTURE_2D, t.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, t.desc.format, w, h, 0, format, type,
+                 nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
+
+  unsigned int passFramebuffer(const Pass &p) {
+    std::vector<unsigned int> textures;
+    std::vector<GLenum> formats;
+    for (Resource r : p.writes) {
+      if (r == 0)
+        return 0;
+      textures.push_back(texture(r));
+      formats.push_back(resources[r].desc.format);
+    }
+    return textures.empty() ? 0 : cachedFramebuffer(textures, formats);
+  }
+
+  // one framebuffer per distinct list of attached textures
+  unsigned int cachedFramebuffer(const std::vector<unsigned int> &textures,
+                                 const std::vector<GLenum> &formats) {
+    auto it = framebuffers.find(textures);
+    if (it != framebuffers.end())
+      return it->second;
+
+    unsigned int fbo;
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    std::vector<GLenum> drawBuffers;
+    for (size_t i = 0; i < textures.size(); i++) {
+      GLenum attachment;
+      if (isDepthStencil(formats[i]))
+        attachment = GL_DEPTH_STENCIL_ATTACHMENT;
+      else if (isDepth(formats[i]))
+        attachment = GL_DEPTH_ATTACHMENT;
+      else
+        drawBuffers.push_back(attachment =
+                                  GL_COLOR_ATTACHMENT0 + drawBuffers.size());
+      glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D,
+                             textures[i], 0);
+    }
+    if (drawBuffers.empty())
+      glDrawBuffer(GL_NONE);
+    else
+      glDrawBuffers((int)drawBuffers.size(), drawBuffers.data());
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+      DBG("RENDERGRAPH::INCOMPLETE_FRAMEBUFFER 0x" << std::hex << status
+                                                   << std::dec);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return framebuffers[textures] = fbo;
+  }
+
+  // frees textures no frame has needed for a while, with the framebuffers
+  // they are attached to
+  void releaseUnused() {
+    for (Target &t : targets)
+      t.idleFrames = t.busyUntil < 0 ? t.idleFrames + 1 : 0;
+
+    for (int i = (int)targets.size() - 1; i >= 0; i--) {
+      if (targets[i].idleFrames < RELEASE_AFTER)
+        continue;
+      unsigned int texture = targets[i].texture;
+      for (auto it = framebuffers.begin(); it != framebuffers.end();)
+        if (std::find(it->first.begin(), it->first.end(), texture) !=
+            it->first.end()) {
+          glDeleteFramebuffers(1, &it->second);
+          it = framebuffers.erase(it);
+        } else {
+          ++it;
+        }
+      glDeleteTextures(1, &texture);
+      targets.erase(targets.begin() + i);
+      for (ResourceInfo &res : resources)
+        if (res.target > i)
+          res.target--;
+    }
+  }
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <map>
+#include <tuple>
+
+#include "gl_ext.hpp"
+
+// Filter and wrap state that would otherwise live on each texture object.
+struct SamplerState {
+  GLenum minFilter = GL_LINEAR_MIPMAP_LINEAR;
+  GLenum magFilter = GL_LINEAR;
+  GLenum wrapS = GL_REPEAT;
+  GLenum wrapT = GL_REPEAT;
+  float anisotropy = 1.0f;
+
+  bool operator<(const SamplerState &o) const {
+    return std::tie(minFilter, magFilter, wrapS, wrapT, anisotropy) <
+           std::tie(o.minFilter, o.magFilter, o.wrapS, o.wrapT, o.anisotropy);
+  }
+};
+
+// Hands out one sampler object per distinct SamplerState so textures share a
+// handful of samplers instead of each carrying its own parameters.
+class SamplerCache {
+public:
+  static SamplerCache &instance() {
+    static SamplerCache cache;
+    return cache;
+  }
+
+  unsigned int get(SamplerState state) {
+    state.anisotropy = GLExt::anisotropy
+                           ? std::clamp(state.anisotropy, 1.0f,
+                                        GLExt::maxAnisotropy)
+                           : 1.0f;
+
+    auto it = samplers.find(state);
+    if (it != samplers.end())
+      return it->second;
+
+    unsigned int ID;
+    glGenSamplers(1, &ID);
+    glSamplerParameteri(ID, GL_TEXTURE_WRAP_S, state.wrapS);
+    glSamplerParameteri(ID, GL_TEXTURE_WRAP_T, state.wrapT);
+    glSamplerParameteri(ID, GL_TEXTURE_MIN_FILTER, state.minFilter);
+    glSamplerParameteri(ID, GL_TEXTURE_MAG_FILTER, state.magFilter);
+    if (state.anisotropy > 1.0f)
+      glSamplerParameterf(ID, GL_TEXTURE_MAX_ANISOTROPY_EXT, state.anisotropy);
+
+    samplers.emplace(state, ID);
+    return ID;
+  }
+
+  void clear() {
+    for (auto &entry : samplers)
+      glDeleteSamplers(1, &entry.second);
+    samplers.clear();
+  }
+
+private:
+  std::map<SamplerState, unsigned int> samplers;
+};
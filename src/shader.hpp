@@ -2,95 +2,148 @@
 
 #include <glad/glad.h>
 
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "debug.hpp"
+#include "gl_ext.hpp"
+#include "shader_reflection.hpp"
+#include "shader_source.hpp"
+#include "uniform_buffer.hpp"
+
+// Compile and link calls that have been issued but not yet checked. The
+// driver can work on many of these at once, so callers start a whole batch
+// before finishing any of them.
+struct ShaderBuild {
+  unsigned int vertex = 0, fragment = 0, program = 0;
+  // by source string number, to name the files in compile errors
+  std::vector<std::string> vertexFiles, fragmentFiles;
+
+  explicit operator bool() const { return program != 0; }
+};
 
 class Shader {
 public:
-  unsigned int ID; // program id
-
-  Shader(const char *vertexPath, const char *fragmentPath) {
-    std::string vertexSource;
-    std::string fragmentSource;
-    std::ifstream vertexFile;
-    std::ifstream fragmentFile;
-    vertexFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    fragmentFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-
-    try {
-      // open the files
-      vertexFile.open(vertexPath);
-      fragmentFile.open(fragmentPath);
-      std::stringstream vertexStream, fragmentStream;
-
-      // read the file buffer into a stream
-      vertexStream << vertexFile.rdbuf();
-      fragmentStream << fragmentFile.rdbuf();
-
-      // close the files
-      vertexFile.close();
-      fragmentFile.close();
-
-      // convert the stream into a string
-      vertexSource = vertexStream.str();
-      fragmentSource = fragmentStream.str();
-    } catch (std::ifstream::failure e) {
-      DBG("ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << e.code() << e.what());
-    }
+  unsigned int ID = 0; // program id, 0 until the first build has linked
+  std::string vertexPath, fragmentPath;
+  ShaderBuild pending;
+  // keywords the sources declare with "#pragma features A B ..."
+  std::vector<std::string> features;
+  // defined in front of both sources, selecting this variant: "NAME" as 1,
+  // "NAME=value" and "NAME(args)=body" as written
+  std::vector<std::string> defines;
+  // every file the last submit read, includes too; editing any of them
+  // calls for a rebuild
+  std::vector<std::string> dependencies;
+  // uniforms, blocks and attributes of ID, rebuilt whenever ID changes
+  ProgramReflection reflection;
 
-    // turn the std::string into c strings
-    const char *vShaderCode = vertexSource.c_str();
-    const char *fShaderCode = fragmentSource.c_str();
+  // deferred only submits the build; poll() later adopts it
+  Shader(const char *vertexPath, const char *fragmentPath,
+         bool deferred = false, std::vector<std::string> defines = {})
+      : vertexPath(vertexPath), fragmentPath(fragmentPath),
+        defines(std::move(defines)) {
+    if (deferred)
+      submit();
+    else
+      reload();
+  };
 
-    // compile the shaders
-    int success;
-    char infoLog[512];
+  // Recompiles from the source files and waits for the result. ID is only
+  // replaced once the new program links, so a broken edit leaves the old
+  // program running.
+  bool reload() { return submit() && poll(true); }
 
-    unsigned int vShaderHandle = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vShaderHandle, 1, &vShaderCode, NULL);
-    glCompileShader(vShaderHandle);
+  // starts a rebuild from the source files, dropping any unfinished one
+  bool submit() {
+    ShaderSource vertex(vertexPath), fragment(fragmentPath);
+    // kept even on failure, so fixing a missing include triggers a rebuild
+    dependencies = vertex.files;
+    dependencies.insert(dependencies.end(), fragment.files.begin(),
+                        fragment.files.end());
+    std::sort(dependencies.begin(), dependencies.end());
+    dependencies.erase(std::unique(dependencies.begin(), dependencies.end()),
+                       dependencies.end());
+    if (!vertex || !fragment)
+      return false;
 
-    glGetShaderiv(vShaderHandle, GL_COMPILE_STATUS, &success);
-    if (!success) {
-      glGetShaderInfoLog(vShaderHandle, 512, NULL, infoLog);
-      DBG("ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog);
-    }
+    features.clear();
+    declaredFeatures(vertex.text, features);
+    declaredFeatures(fragment.text, features);
 
-    unsigned int fShaderHandle = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fShaderHandle, 1, &fShaderCode, NULL);
-    glCompileShader(fShaderHandle);
+    discard(pending);
+    pending = start(inject(vertex.text, defines),
+                    inject(fragment.text, defines));
+    pending.vertexFiles = vertex.files;
+    pending.fragmentFiles = fragment.files;
+    return true;
+  }
 
-    glGetShaderiv(fShaderHandle, GL_COMPILE_STATUS, &success);
-    if (!success) {
-      glGetShaderInfoLog(fShaderHandle, 512, NULL, infoLog);
-      DBG("ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog);
-    }
+  // Adopts the pending build once the driver is done with it, or right away
+  // when wait is set. Returns true if that swapped in a new program.
+  bool poll(bool wait = false) {
+    if (!pending || (!wait && !done(pending)))
+      return false;
 
-	// attch and link the program
-    ID = glCreateProgram();
-    glAttachShader(ID, vShaderHandle);
-    glAttachShader(ID, fShaderHandle);
-    glLinkProgram(ID);
+    unsigned int program = finish(pending);
+    pending = ShaderBuild();
+    if (!program)
+      return false;
 
-    glGetProgramiv(ID, GL_LINK_STATUS, &success);
-    if (!success) {
-      glGetProgramInfoLog(ID, 512, NULL, infoLog);
-      DBG("FAILED: could not link program: " << infoLog);
-    }
+    if (ID)
+      glDeleteProgram(ID);
+    ID = program;
+    reflection.build(ID);
+    return true;
+  }
 
-	glDeleteShader(vShaderHandle);
-	glDeleteShader(fShaderHandle);
-  };
+  bool ready() const { return ID != 0; }
+  bool compiling() const { return (bool)pending; }
 
-  void use() 
+  void use()
   {
-	glUseProgram(ID);  
+	glUseProgram(ID);
   };
 
+  // Typed setters for the program in use. The location comes from the
+  // reflection table, so there is no lookup by name; uniforms the program
+  // does not have (or optimised out) are ignored like location -1 is. Debug
+  // builds report a type that does not match the GLSL declaration.
+  template <typename T> void set(UniformId id, const T &value) const {
+    setArray(id, &value, 1);
+  }
+  template <typename T, size_t N>
+  void set(UniformId id, const T (&values)[N]) const {
+    setArray(id, values, (int)N);
+  }
+  template <typename T>
+  void set(UniformId id, const std::vector<T> &values) const {
+    setArray(id, values.data(), (int)values.size());
+  }
+  void set(UniformId id, bool value) const { set(id, (int)value); }
+
+  template <typename T>
+  void setArray(UniformId id, const T *values, int count) const {
+    const ProgramReflection::Uniform *u = reflection.find(id);
+    if (!u)
+      return;
+#ifndef NDEBUG
+    if (!uniformTypeMatches<T>(u->type) || count > u->count) {
+      DBG("ERROR::SHADER::UNIFORM_MISMATCH "
+          << id.name() << ": GL type 0x" << std::hex << u->type
+          << " set as 0x" << UniformTraits<T>::type << std::dec << ", "
+          << count << " values for " << u->count);
+      return;
+    }
+#endif
+    UniformTraits<T>::upload(u->location, count, values);
+  }
+
   void setBool(const std::string &name, bool value) const
   {
 	  glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
@@ -103,7 +156,148 @@ public:
   {
 	  glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
   }
-};
 
+  // appends the keywords of every "#pragma features" line not already in
+  // out; the compiler itself ignores the unknown pragma
+  static void declaredFeatures(const std::string &source,
+                               std::vector<std::string> &out) {
+    std::istringstream in(source);
+    std::string line, hash, pragma, word;
+    while (std::getline(in, line)) {
+      std::istringstream words(line);
+      if (!(words >> hash >> pragma) || hash != "#pragma" ||
+          pragma != "features")
+        continue;
+      while (words >> word)
+        if (std::find(out.begin(), out.end(), word) == out.end())
+          out.push_back(word);
+    }
+  }
+
+  // Puts a "#define NAME 1" per name, or "#define NAME value" for
+  // "NAME=value", right after #version, which has to stay first, then resets
+  // the line counter so compile errors still point at the file's own lines.
+  static std::string inject(const std::string &source,
+                            const std::vector<std::string> &defines) {
+    if (defines.empty())
+      return source;
+
+    size_t body = 0;
+    int version = 110, bodyLine = 1;
+    size_t at = source.find("#version");
+    if (at != std::string::npos) {
+      body = source.find('\n', at);
+      body = body == std::string::npos ? source.size() : body + 1;
+      version = std::atoi(source.c_str() + at + 8);
+      bodyLine += (int)std::count(source.begin(), source.begin() + body, '\n');
+    }
+
+    std::string out = source.substr(0, body);
+    if (body && out.back() != '\n')
+      out += '\n';
+    for (const std::string &define : defines) {
+      size_t equals = define.find('=');
+      if (equals == std::string::npos)
+        out += "#define " + define + " 1\n";
+      else
+        out += "#define " + define.substr(0, equals) + " " +
+               define.substr(equals + 1) + "\n";
+    }
+    out += ShaderSource::lineDirective(version, bodyLine);
+    out.append(source, body, std::string::npos);
+    return out;
+  }
+
+  // issues the compile and link without querying any status, which would
+  // make the driver finish them on the spot
+  static ShaderBuild start(const std::string &vertexSource,
+                           const std::string &fragmentSource) {
+    ShaderBuild b;
+    b.vertex = submitShader(GL_VERTEX_SHADER, vertexSource);
+    b.fragment = submitShader(GL_FRAGMENT_SHADER, fragmentSource);
+
+    // attach and link the program
+    b.program = glCreateProgram();
+    glAttachShader(b.program, b.vertex);
+    glAttachShader(b.program, b.fragment);
+    glLinkProgram(b.program);
+    return b;
+  }
+
+  // whether finish() would return without blocking; without
+  // KHR_parallel_shader_compile there is no way to tell, so always true
+  static bool done(const ShaderBuild &b) {
+    if (!GLExt::parallelShaderCompile)
+      return true;
+    int complete;
+    glGetProgramiv(b.program, GL_COMPLETION_STATUS_KHR, &complete);
+    return complete;
+  }
+
+  // checks the results, logs any errors and returns the program or 0
+  static unsigned int finish(const ShaderBuild &b) {
+    int success;
+    char infoLog[512];
+
+    bool compiled = checkShader(b.vertex, "VERTEX", b.vertexFiles);
+    compiled =
+        checkShader(b.fragment, "FRAGMENT", b.fragmentFiles) && compiled;
+
+    unsigned int program = b.program;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+      // a failed compile already explains the failed link
+      if (compiled) {
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
+        DBG("FAILED: could not link program: " << infoLog);
+      }
+      glDeleteProgram(program);
+      program = 0;
+    } else {
+      bindUniformBlocks(program);
+    }
+
+    glDeleteShader(b.vertex);
+    glDeleteShader(b.fragment);
+    return program;
+  }
+
+  // compiles and links a program, or returns 0
+  static unsigned int build(const std::string &vertexSource,
+                            const std::string &fragmentSource) {
+    return finish(start(vertexSource, fragmentSource));
+  }
+
+  static void discard(const ShaderBuild &b) {
+    // deleting ignores 0 handles
+    glDeleteProgram(b.program);
+    glDeleteShader(b.vertex);
+    glDeleteShader(b.fragment);
+  }
 
+private:
+  static unsigned int submitShader(GLenum type, const std::string &source) {
+    const char *code = source.c_str();
+    unsigned int handle = glCreateShader(type);
+    glShaderSource(handle, 1, &code, NULL);
+    glCompileShader(handle);
+    return handle;
+  }
 
+  static bool checkShader(unsigned int handle, const char *stage,
+                          const std::vector<std::string> &files) {
+    int success;
+    glGetShaderiv(handle, GL_COMPILE_STATUS, &success);
+    if (!success) {
+      char infoLog[512];
+      glGetShaderInfoLog(handle, 512, NULL, infoLog);
+      // the log locates errors by source string number
+      std::string legend;
+      for (size_t i = 0; i < files.size(); i++)
+        legend += "  " + std::to_string(i) + ": " + files[i] + "\n";
+      DBG("ERROR::SHADER::" << stage << "::COMPILATION_FAILED\n"
+                            << infoLog << legend);
+    }
+    return success;
+  }
+};
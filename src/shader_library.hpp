@@ -0,0 +1,269 @@
+#pragma once
+
+#include "assets.hpp"
+#include "debug.hpp"
+#include "shader.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Owns the programs and rebuilds them when their sources change on disk,
+// including any file they #include, and only the programs that use it.
+// Sources are only watched when assets come from disk (see assets.hpp).
+// On Linux the source directories are watched with inotify, elsewhere the
+// file times are polled. Builds are only submitted to the driver and picked
+// up once KHR_parallel_shader_compile reports them complete, and since a
+// program is only swapped in once it links, a broken edit keeps the old one
+// drawing.
+class ShaderLibrary {
+public:
+  // run with the program bound after every successful (re)link, e.g. to
+  // point the sampler uniforms at their texture units again
+  using Setup = std::function<void(Shader &)>;
+
+  ShaderLibrary() {
+#ifdef __linux__
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+      DBG("ERROR::SHADER_LIBRARY::INOTIFY_INIT_FAILED, polling instead");
+#endif
+  }
+  ~ShaderLibrary() {
+#ifdef __linux__
+    if (fd >= 0)
+      close(fd);
+#endif
+  }
+  ShaderLibrary(const ShaderLibrary &) = delete;
+  ShaderLibrary &operator=(const ShaderLibrary &) = delete;
+
+  // Submits the build and returns right away. The shader is a not-ready
+  // handle (ID 0) until update() or finish() adopts the linked program, so
+  // a batch of loads compiles in parallel with whatever the caller does next.
+  // The reference stays valid for the lifetime of the library. defines
+  // apply to every variant of the program (see Shader::defines).
+  Shader &load(const char *vertexPath, const char *fragmentPath,
+               Setup setup = nullptr, std::vector<std::string> defines = {}) {
+    families.push_back(std::make_unique<Family>(Family{
+        vertexPath, fragmentPath, std::move(setup), std::move(defines), {}}));
+    return add(*families.back(), 0, {}).shader;
+  }
+
+  // The variant of a loaded shader with the features in mask #defined, bit
+  // i standing for base.features[i]. Each variant is built once, on first
+  // request, and is not ready until its build is adopted like a load's.
+  Shader &variant(const Shader &base, uint32_t mask) {
+    Family &f = *byShader.at(&base)->family;
+    const auto &declared = f.variants.at(0)->shader.features;
+    if (declared.size() < 32)
+      mask &= (1u << declared.size()) - 1;
+
+    auto found = f.variants.find(mask);
+    if (found != f.variants.end())
+      return found->second->shader;
+
+    std::vector<std::string> defines;
+    for (size_t i = 0; i < declared.size() && i < 32; i++)
+      if (mask & (1u << i))
+        defines.push_back(declared[i]);
+    return add(f, mask, std::move(defines)).shader;
+  }
+  Shader &variant(const Shader &base,
+                  std::initializer_list<const char *> names) {
+    return variant(base, featureMask(base, names));
+  }
+
+  // submits the listed variants now, e.g. every combination a level uses,
+  // so they compile during loading instead of on first draw
+  void precompile(const Shader &base, std::initializer_list<uint32_t> masks) {
+    for (uint32_t mask : masks)
+      variant(base, mask);
+  }
+
+  static uint32_t featureMask(const Shader &base,
+                              std::initializer_list<const char *> names) {
+    uint32_t mask = 0;
+    for (const char *name : names) {
+      auto it = std::find(base.features.begin(), base.features.end(), name);
+      if (it == base.features.end() || it - base.features.begin() >= 32)
+        DBG("ERROR::SHADER_LIBRARY::UNKNOWN_FEATURE " << name << " in "
+                                                      << base.fragmentPath);
+      else
+        mask |= 1u << (it - base.features.begin());
+    }
+    return mask;
+  }
+
+  // Call once per frame. Resubmits every program whose sources changed
+  // since the last call (once, however many events arrived) and adopts the
+  // builds the driver has finished, so neither loads nor edits stall a frame.
+  void update() {
+    std::set<Entry *> dirty;
+    collect(dirty);
+    for (Entry *e : dirty) {
+      e->shader.submit();
+      rewatch(*e);
+    }
+    adopt(false);
+  }
+
+  // blocks until every submitted build is adopted, e.g. before the first
+  // frame; a no-op for builds that already failed
+  void finish() { adopt(true); }
+
+  // builds still being compiled by the driver
+  size_t pending() const {
+    size_t n = 0;
+    for (auto &e : entries)
+      n += e->shader.compiling();
+    return n;
+  }
+
+private:
+  struct Entry;
+  // one pair of source files and all the variants built from it
+  struct Family {
+    std::string vertexPath, fragmentPath;
+    Setup setup;
+    std::vector<std::string> defines;     // common to all variants
+    std::map<uint32_t, Entry *> variants; // by feature mask, 0 is the base
+  };
+  struct Entry {
+    Shader shader;
+    Family *family;
+  };
+  struct File {
+    std::vector<Entry *> users;
+    std::filesystem::file_time_type stamp; // only used when polling
+  };
+
+  std::vector<std::unique_ptr<Family>> families;
+  std::vector<std::unique_ptr<Entry>> entries;
+  std::map<const Shader *, Entry *> byShader;
+  std::map<std::string, File> files; // keyed by normalised path
+  std::map<int, std::filesystem::path> dirs; // inotify watch -> directory
+  int fd = -1;
+
+  Entry &add(Family &f, uint32_t mask, std::vector<std::string> defines) {
+    defines.insert(defines.begin(), f.defines.begin(), f.defines.end());
+    entries.push_back(std::make_unique<Entry>(
+        Entry{Shader(f.vertexPath.c_str(), f.fragmentPath.c_str(), true,
+                     std::move(defines)),
+              &f}));
+    Entry &e = *entries.back();
+    f.variants[mask] = &e;
+    byShader[&e.shader] = &e;
+    rewatch(e);
+    return e;
+  }
+
+  void adopt(bool wait) {
+    for (auto &e : entries) {
+      bool reloaded = e->shader.ready();
+      if (!e->shader.poll(wait))
+        continue;
+      if (reloaded)
+        DBG("SHADER::RELOADED " << e->shader.vertexPath << " "
+                                << e->shader.fragmentPath);
+      configure(*e);
+    }
+  }
+
+  void configure(Entry &e) {
+    if (!e.family->setup)
+      return;
+    e.shader.use();
+    e.family->setup(e.shader);
+  }
+
+  static std::filesystem::path directoryOf(const std::filesystem::path &p) {
+    return p.has_parent_path() ? p.parent_path() : ".";
+  }
+  static std::string key(const std::filesystem::path &dir,
+                         const std::filesystem::path &name) {
+    return (dir / name).lexically_normal().string();
+  }
+
+  // follows the files the last submit read, so adding or dropping an
+  // #include takes effect with the same save
+  void rewatch(Entry &e) {
+    for (auto &file : files) {
+      auto &users = file.second.users;
+      users.erase(std::remove(users.begin(), users.end(), &e), users.end());
+    }
+    watch(e.family->vertexPath, &e);
+    watch(e.family->fragmentPath, &e);
+    for (const std::string &path : e.shader.dependencies)
+      watch(path, &e);
+  }
+
+  void watch(const std::string &path, Entry *e) {
+    // embedded sources cannot change
+    if (!Assets::fromDisk())
+      return;
+    std::filesystem::path p(Assets::diskPath(path));
+    std::filesystem::path dir = directoryOf(p);
+    File &f = files[key(dir, p.filename())];
+    if (std::find(f.users.begin(), f.users.end(), e) != f.users.end())
+      return;
+    f.users.push_back(e);
+
+    std::error_code ec;
+    f.stamp = std::filesystem::last_write_time(p, ec);
+#ifdef __linux__
+    // watch the directory rather than the file: editors that save by
+    // renaming a temporary over the original would orphan a file watch
+    if (fd >= 0) {
+      int wd =
+          inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+      if (wd < 0)
+        DBG("ERROR::SHADER_LIBRARY::WATCH_FAILED " << dir);
+      else
+        dirs[wd] = dir;
+    }
+#endif
+  }
+
+  void collect(std::set<Entry *> &dirty) {
+#ifdef __linux__
+    if (fd >= 0) {
+      alignas(inotify_event) char buf[4096];
+      ssize_t n;
+      while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + n;) {
+          const inotify_event *ev = (const inotify_event *)p;
+          p += sizeof(inotify_event) + ev->len;
+          auto dir = dirs.find(ev->wd);
+          if (!ev->len || dir == dirs.end())
+            continue;
+          auto f = files.find(key(dir->second, ev->name));
+          if (f != files.end())
+            dirty.insert(f->second.users.begin(), f->second.users.end());
+        }
+      }
+      return;
+    }
+#endif
+    for (auto &[path, f] : files) {
+      std::error_code ec;
+      auto stamp = std::filesystem::last_write_time(path, ec);
+      if (!ec && stamp != f.stamp) {
+        f.stamp = stamp;
+        dirty.insert(f.users.begin(), f.users.end());
+      }
+    }
+  }
+};
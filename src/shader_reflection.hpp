@@ -0,0 +1,232 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "debug.hpp"
+
+// Plain value types matching the GLSL ones, for Shader::set. Matrices are
+// column-major like GLSL's.
+namespace glsl {
+struct vec2 {
+  float x, y;
+};
+struct vec3 {
+  float x, y, z;
+};
+struct vec4 {
+  float x, y, z, w;
+};
+struct ivec2 {
+  int x, y;
+};
+struct ivec3 {
+  int x, y, z;
+};
+struct ivec4 {
+  int x, y, z, w;
+};
+struct mat2 {
+  float m[4];
+};
+struct mat3 {
+  float m[9];
+};
+struct mat4 {
+  float m[16];
+};
+} // namespace glsl
+
+// A uniform name interned to a small integer once, typically in a static, so
+// setting a uniform indexes an array instead of hashing a string. Ids stay
+// valid across programs and reloads.
+class UniformId {
+public:
+  explicit UniformId(const std::string &name) : index(intern(name)) {}
+
+  unsigned int index;
+
+  const std::string &name() const { return names()[index]; }
+
+  // the id of name if one was created, else -1
+  static int find(const std::string &name) {
+    auto it = lookup().find(name);
+    return it == lookup().end() ? -1 : (int)it->second;
+  }
+
+private:
+  static std::vector<std::string> &names() {
+    static std::vector<std::string> names;
+    return names;
+  }
+  static std::map<std::string, unsigned int> &lookup() {
+    static std::map<std::string, unsigned int> lookup;
+    return lookup;
+  }
+  static unsigned int intern(const std::string &name) {
+    auto it = lookup().find(name);
+    if (it != lookup().end())
+      return it->second;
+    names().push_back(name);
+    return lookup()[name] = (unsigned int)names().size() - 1;
+  }
+};
+
+// GL type and upload call for each C++ type Shader::set accepts; any other
+// type fails to compile.
+template <typename T> struct UniformTraits;
+
+#define UNIFORM_TRAITS(T, glType, call)                                        \
+  template <> struct UniformTraits<T> {                                        \
+    static constexpr GLenum type = glType;                                     \
+    static void upload(int location, int count, const T *v) { call; }          \
+  }
+
+UNIFORM_TRAITS(float, GL_FLOAT, glUniform1fv(location, count, v));
+UNIFORM_TRAITS(glsl::vec2, GL_FLOAT_VEC2, glUniform2fv(location, count, &v->x));
+UNIFORM_TRAITS(glsl::vec3, GL_FLOAT_VEC3, glUniform3fv(location, count, &v->x));
+UNIFORM_TRAITS(glsl::vec4, GL_FLOAT_VEC4, glUniform4fv(location, count, &v->x));
+UNIFORM_TRAITS(int, GL_INT, glUniform1iv(location, count, v));
+UNIFORM_TRAITS(glsl::ivec2, GL_INT_VEC2, glUniform2iv(location, count, &v->x));
+UNIFORM_TRAITS(glsl::ivec3, GL_INT_VEC3, glUniform3iv(location, count, &v->x));
+UNIFORM_TRAITS(glsl::ivec4, GL_INT_VEC4, glUniform4iv(location, count, &v->x));
+UNIFORM_TRAITS(unsigned int, GL_UNSIGNED_INT,
+               glUniform1uiv(location, count, v));
+UNIFORM_TRAITS(glsl::mat2, GL_FLOAT_MAT2,
+               glUniformMatrix2fv(location, count, GL_FALSE, v->m));
+UNIFORM_TRAITS(glsl::mat3, GL_FLOAT_MAT3,
+               glUniformMatrix3fv(location, count, GL_FALSE, v->m));
+UNIFORM_TRAITS(glsl::mat4, GL_FLOAT_MAT4,
+               glUniformMatrix4fv(location, count, GL_FALSE, v->m));
+
+#undef UNIFORM_TRAITS
+
+// What a linked program declares, read once after each link.
+class ProgramReflection {
+public:
+  struct Uniform {
+    int location = -1;
+    GLenum type = 0;
+    int count = 0; // array length, 1 for plain uniforms
+  };
+  struct Block {
+    std::string name;
+    unsigned int index;
+    int size;    // GL_UNIFORM_BLOCK_DATA_SIZE
+    int binding; // GL_UNIFORM_BLOCK_BINDING
+  };
+  struct Attribute {
+    std::string name;
+    int location;
+    GLenum type;
+    int count;
+  };
+
+  std::vector<Block> blocks;
+  std::vector<Attribute> attributes;
+
+  void build(unsigned int program) {
+    uniforms.clear();
+    blocks.clear();
+    attributes.clear();
+
+    int count = 0, maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<char> name(maxLength + 1);
+    for (int i = 0; i < count; i++) {
+      Uniform u;
+      glGetActiveUniform(program, i, (int)name.size(), NULL, &u.count, &u.type,
+                         name.data());
+      u.location = glGetUniformLocation(program, name.data());
+      // block members have no location, they are set through the block
+      if (u.location < 0)
+        continue;
+      // arrays are reported as "name[0]", accept plain "name" as well
+      std::string full = name.data();
+      add(full, u);
+      if (full.size() > 3 && full.compare(full.size() - 3, 3, "[0]") == 0)
+        add(full.substr(0, full.size() - 3), u);
+    }
+
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH,
+                   &maxLength);
+    name.resize(maxLength + 1);
+    for (int i = 0; i < count; i++) {
+      Block b;
+      glGetActiveUniformBlockName(program, i, (int)name.size(), NULL,
+                                  name.data());
+      b.name = name.data();
+      b.index = i;
+      glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_DATA_SIZE,
+                                &b.size);
+      glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_BINDING,
+                                &b.binding);
+      blocks.push_back(b);
+    }
+
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+    name.resize(maxLength + 1);
+    for (int i = 0; i < count; i++) {
+      Attribute a;
+      glGetActiveAttrib(program, i, (int)name.size(), NULL, &a.count, &a.type,
+                        name.data());
+      a.name = name.data();
+      a.location = glGetAttribLocation(program, name.data());
+      attributes.push_back(a);
+    }
+  }
+
+  // nullptr if the program has no such (active) uniform
+  const Uniform *find(UniformId id) const {
+    if (id.index >= uniforms.size() || uniforms[id.index].location < 0)
+      return nullptr;
+    return &uniforms[id.index];
+  }
+
+  const Block *block(const std::string &name) const {
+    for (const Block &b : blocks)
+      if (b.name == name)
+        return &b;
+    return nullptr;
+  }
+
+private:
+  std::vector<Uniform> uniforms; // indexed by UniformId
+
+  void add(const std::string &name, const Uniform &u) {
+    UniformId id(name);
+    if (id.index >= uniforms.size())
+      uniforms.resize(id.index + 1);
+    uniforms[id.index] = u;
+  }
+};
+
+// int also sets bools and samplers, as glUniform1i does
+template <typename T> inline bool uniformTypeMatches(GLenum type) {
+  return type == UniformTraits<T>::type;
+}
+template <> inline bool uniformTypeMatches<int>(GLenum type) {
+  switch (type) {
+  case GL_INT:
+  case GL_BOOL:
+  case GL_SAMPLER_1D:
+  case GL_SAMPLER_2D:
+  case GL_SAMPLER_3D:
+  case GL_SAMPLER_CUBE:
+  case GL_SAMPLER_2D_SHADOW:
+  case GL_SAMPLER_2D_ARRAY:
+  case GL_SAMPLER_2D_MULTISAMPLE:
+  case GL_SAMPLER_BUFFER:
+  case GL_INT_SAMPLER_2D:
+  case GL_UNSIGNED_INT_SAMPLER_2D:
+    return true;
+  default:
+    return false;
+  }
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "assets.hpp"
+#include "debug.hpp"
+
+// One GLSL asset with its #include "file" directives expanded, which the GL
+// compiler has no notion of. Paths are relative to the including file, and a
+// file guarded by #pragma once or an #ifndef/#define pair is pasted only
+// once. Every file read gets a source string number, its index in files, and
+// #line directives make the compiler report errors as number(line) of the
+// original file. Includes are expanded whatever #if block they sit in.
+class ShaderSource {
+public:
+  std::string text;
+  std::vector<std::string> files; // every file read, [0] is the root
+  // direct includes of each file, i.e. the edges of the dependency graph
+  std::map<std::string, std::vector<std::string>> includes;
+  int version = 110; // of the root's #version line
+
+  explicit ShaderSource(const std::string &path) {
+    ok = expand(normal(path));
+  }
+
+  explicit operator bool() const { return ok; }
+
+  // "#line" such that the next line is numbered line (of source string
+  // file, if given); GLSL before 3.30 numbers it line + 1 instead
+  static std::string lineDirective(int version, int line, int file = -1) {
+    std::string out = "#line ";
+    out += std::to_string(version >= 330 ? line : line - 1);
+    if (file >= 0)
+      out += " " + std::to_string(file);
+    return out + "\n";
+  }
+
+  static bool readFile(const std::string &path, std::string &out) {
+    if (Assets::read(path, out))
+      return true;
+    DBG("ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << path);
+    return false;
+  }
+
+private:
+  bool ok = false;
+  std::vector<std::string> stack; // files being expanded, to catch cycles
+  std::set<std::string> once;     // guarded files already pasted
+
+  static std::string normal(const std::filesystem::path &p) {
+    return p.lexically_normal().string();
+  }
+
+  int indexOf(const std::string &path) {
+    auto it = std::find(files.begin(), files.end(), path);
+    if (it != files.end())
+      return (int)(it - files.begin());
+    files.push_back(path);
+    return (int)files.size() - 1;
+  }
+
+  // the first word of a preprocessor line, with the rest left in words
+  static std::string directive(const std::string &line,
+                               std::istringstream &words) {
+    words.str(line);
+    std::string word;
+    if (!(words >> word) || word[0] != '#')
+      return "";
+    // "#include" and "# include" are the same directive
+    if (word.size() == 1 && !(words >> word))
+      return "";
+    return word[0] == '#' ? word.substr(1) : word;
+  }
+
+  static bool blank(const std::string &line) {
+    size_t first = line.find_first_not_of(" \t\r");
+    return first == std::string::npos || line.compare(first, 2, "//") == 0;
+  }
+
+  // #pragma once, or an #ifndef X / #define X pair, ahead of any code
+  static bool guarded(const std::string &text) {
+    std::istringstream in(text);
+    std::string line, guard;
+    while (std::getline(in, line)) {
+      std::istringstream words;
+      std::string name = directive(line, words), arg;
+      words >> arg;
+      if (name == "pragma" && arg == "once")
+        return true;
+      if (!guard.empty())
+        return name == "define" && arg == guard;
+      if (name == "ifndef")
+        guard = arg;
+      else if (!blank(line))
+        return false;
+    }
+    return false;
+  }
+
+  bool expand(const std::string &path) {
+    const int index = indexOf(path);
+    std::string source;
+    if (!readFile(path, source))
+      return false;
+    if (guarded(source))
+      once.insert(path);
+    stack.push_back(path);
+
+    std::istringstream in(source);
+    std::string line;
+    for (int lineNo = 1; std::getline(in, line); lineNo++) {
+      std::istringstream words;
+      std::string name = directive(line, words), target;
+      words >> target;
+      if (name == "version" && index == 0) {
+        version = std::atoi(target.c_str());
+      } else if (name == "pragma" && target == "once") {
+        // the compiler would warn about the unknown pragma
+        line.clear();
+      } else if (name == "include") {
+        if (target.size() < 3 ||
+            !((target.front() == '"' && target.back() == '"') ||
+              (target.front() == '<' && target.back() == '>'))) {
+          DBG("ERROR::SHADER::BAD_INCLUDE " << path << ":" << lineNo);
+          return false;
+        }
+        std::string resolved =
+            normal(std::filesystem::path(path).parent_path() /
+                   target.substr(1, target.size() - 2));
+        includes[path].push_back(resolved);
+
+        if (std::find(stack.begin(), stack.end(), resolved) != stack.end()) {
+          DBG("ERROR::SHADER::INCLUDE_CYCLE " << path << ":" << lineNo << " "
+                                              << resolved);
+          return false;
+        }
+        if (!once.count(resolved)) {
+          text += lineDirective(version, 1, indexOf(resolved));
+          if (!expand(resolved))
+            return false;
+          text += lineDirective(version, lineNo + 1, index);
+          continue;
+        }
+        // already pasted; a blank line keeps the numbering
+        line.clear();
+      }
+      text += line;
+      text += '\n';
+    }
+
+    stack.pop_back();
+    return true;
+  }
+};
@@ -0,0 +1,54 @@
+#version 330 core
+// The passes of Bloom, one variant each. Every level of the pyramid is half
+// the size of the one above, so the fixed kernels reach twice as far at
+// each step down and the whole pyramid costs about a third more than its
+// top level, however wide the glow.
+#pragma features PREFILTER DOWNSAMPLE BLUR UPSAMPLE COMPOSITE
+#include "blur.glsl"
+out vec4 FragColor;
+
+in vec2 TexCoord;
+
+uniform sampler2D source; // the level being read
+uniform sampler2D detail; // UPSAMPLE: this level's blur, COMPOSITE: the scene
+
+uniform float threshold; // brightness where the glow starts
+uniform float knee;      // width of the soft transition below it
+uniform float spread;    // 0..1, how much the wider levels add
+uniform float intensity;
+
+// 4 bilinear fetches at the corners of the centre texel, which average
+// the 4x4 source texels around it
+vec4 downsample(vec2 uv)
+{
+	vec2 texel = 1.0 / vec2(textureSize(source, 0));
+	return 0.25 * (texture(source, uv + vec2(-1.0, -1.0) * texel) +
+	               texture(source, uv + vec2(1.0, -1.0) * texel) +
+	               texture(source, uv + vec2(-1.0, 1.0) * texel) +
+	               texture(source, uv + vec2(1.0, 1.0) * texel));
+}
+
+void main()
+{
+#if defined(PREFILTER)
+	vec4 c = downsample(TexCoord);
+	float brightness = max(c.r, max(c.g, c.b));
+	float soft = clamp(brightness - threshold + knee, 0.0, 2.0 * knee);
+	soft = soft * soft / (4.0 * knee + 1e-4);
+	float contribution = max(soft, brightness - threshold) /
+	                     max(brightness, 1e-4);
+	FragColor = vec4(c.rgb * contribution, 1.0);
+#elif defined(DOWNSAMPLE)
+	FragColor = downsample(TexCoord);
+#elif defined(BLUR)
+	FragColor = blur(source, TexCoord);
+#elif defined(UPSAMPLE)
+	FragColor = texture(detail, TexCoord) + spread * texture(source, TexCoord);
+#elif defined(COMPOSITE)
+	vec4 scene = texture(detail, TexCoord);
+	FragColor = vec4(scene.rgb + intensity * texture(source, TexCoord).rgb,
+	                 scene.a);
+#else
+	FragColor = texture(source, TexCoord);
+#endif
+}
@@ -0,0 +1,19 @@
+#pragma once
+// 9-tap Gaussian along blurDirection, which is in source texels. Pairs of
+// taps are merged into one bilinear fetch placed between them at the ratio
+// of their weights, so it takes 5 fetches instead of 9.
+
+uniform vec2 blurDirection;
+
+vec4 blur(sampler2D source, vec2 uv)
+{
+	const float offset[3] = float[](0.0, 1.3846153846, 3.2307692308);
+	const float weight[3] = float[](0.2270270270, 0.3162162162, 0.0702702703);
+	vec2 stride = blurDirection / vec2(textureSize(source, 0));
+	vec4 sum = texture(source, uv) * weight[0];
+	for (int i = 1; i < 3; i++) {
+		sum += texture(source, uv + stride * offset[i]) * weight[i];
+		sum += texture(source, uv - stride * offset[i]) * weight[i];
+	}
+	return sum;
+}
@@ -0,0 +1,38 @@
+#pragma once
+// The compact form of Timothy Lottes' FXAA: estimates the edge direction
+// from the luma of the four diagonal neighbours and blends along it, unless
+// that would leave the local luma range. Wants display-ready colour, so it
+// runs after tone mapping.
+
+const float FXAA_REDUCE_MIN = 1.0 / 128.0;
+const float FXAA_REDUCE_MUL = 1.0 / 8.0;
+const float FXAA_SPAN_MAX = 8.0;
+
+vec4 fxaa(sampler2D source, vec2 uv)
+{
+	vec2 texel = 1.0 / vec2(textureSize(source, 0));
+	const vec3 toLuma = vec3(0.299, 0.587, 0.114);
+	vec4 center = texture(source, uv);
+	float lumaM = dot(center.rgb, toLuma);
+	float lumaNW = dot(texture(source, uv + vec2(-1.0, -1.0) * texel).rgb, toLuma);
+	float lumaNE = dot(texture(source, uv + vec2(1.0, -1.0) * texel).rgb, toLuma);
+	float lumaSW = dot(texture(source, uv + vec2(-1.0, 1.0) * texel).rgb, toLuma);
+	float lumaSE = dot(texture(source, uv + vec2(1.0, 1.0) * texel).rgb, toLuma);
+	float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+	float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+
+	vec2 dir = vec2((lumaSW + lumaSE) - (lumaNW + lumaNE),
+	                (lumaNW + lumaSW) - (lumaNE + lumaSE));
+	float reduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25 *
+	                   FXAA_REDUCE_MUL, FXAA_REDUCE_MIN);
+	float scale = 1.0 / (min(abs(dir.x), abs(dir.y)) + reduce);
+	dir = clamp(dir * scale, -FXAA_SPAN_MAX, FXAA_SPAN_MAX) * texel;
+
+	vec3 inner = 0.5 * (texture(source, uv - dir / 6.0).rgb +
+	                    texture(source, uv + dir / 6.0).rgb);
+	vec3 outer = 0.5 * inner + 0.25 * (texture(source, uv - dir * 0.5).rgb +
+	                                   texture(source, uv + dir * 0.5).rgb);
+	float lumaOuter = dot(outer, toLuma);
+	bool outside = lumaOuter < lumaMin || lumaOuter > lumaMax;
+	return vec4(outside ? inner : outer, center.a);
+}
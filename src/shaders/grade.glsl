@@ -0,0 +1,14 @@
+#pragma once
+// Contrast around mid grey, saturation against Rec. 709 luma, then a tint.
+
+uniform float gradeContrast;
+uniform float gradeSaturation;
+uniform vec3 gradeTint;
+
+vec4 grade(vec4 color)
+{
+	vec3 c = (color.rgb - 0.5) * gradeContrast + 0.5;
+	float luma = dot(c, vec3(0.2126, 0.7152, 0.0722));
+	c = mix(vec3(luma), c, gradeSaturation) * gradeTint;
+	return vec4(clamp(c, 0.0, 1.0), color.a);
+}
@@ -0,0 +1,6 @@
+#version 330 core
+// Occlusion queries only count samples, colour and depth writes are off.
+
+void main()
+{
+}
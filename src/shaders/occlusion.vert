@@ -0,0 +1,19 @@
+#version 330 core
+// A box's 12 triangles made from gl_VertexID alone, drawn with
+// glDrawArrays(GL_TRIANGLES, 0, 36) for occlusion queries. boxMin and
+// boxMax are in normalized device coordinates, like the scene's vertices.
+
+uniform vec3 boxMin;
+uniform vec3 boxMax;
+
+// corners numbered by their bits: 1 is +x, 2 is +y, 4 is +z
+const int corners[36] = int[](
+	0, 2, 6,  0, 6, 4,   1, 3, 7,  1, 7, 5,   0, 1, 5,  0, 5, 4,
+	2, 3, 7,  2, 7, 6,   0, 1, 3,  0, 3, 2,   4, 5, 7,  4, 7, 6);
+
+void main()
+{
+	int c = corners[gl_VertexID];
+	vec3 corner = vec3(c & 1, (c >> 1) & 1, (c >> 2) & 1);
+	gl_Position = vec4(mix(boxMin, boxMax, corner), 1.0);
+}
@@ -0,0 +1,31 @@
+#version 330 core
+// One fused post-processing pass, assembled by PostChain through defines:
+// POST_SOURCE names the effect that reads the input, which may sample
+// around the pixel; POST_APPLY(c) chains the per-pixel effects that follow
+// it, so they cost no extra trip through memory.
+#include "tonemap.glsl"
+#include "grade.glsl"
+#include "blur.glsl"
+#include "fxaa.glsl"
+out vec4 FragColor;
+
+in vec2 TexCoord;
+
+uniform sampler2D source;
+
+vec4 fetch(sampler2D source, vec2 uv)
+{
+	return texture(source, uv);
+}
+
+#ifndef POST_SOURCE
+#define POST_SOURCE fetch
+#endif
+#ifndef POST_APPLY
+#define POST_APPLY(c) (c)
+#endif
+
+void main()
+{
+	FragColor = POST_APPLY(POST_SOURCE(source, TexCoord));
+}
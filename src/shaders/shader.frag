@@ -1,4 +1,6 @@
 #version 330 core
+#pragma features VERTEX_COLOR
+#include "uniforms.glsl"
 out vec4 FragColor;
 
 in vec3 VertexColor;
@@ -9,6 +11,10 @@ uniform sampler2D tex1;
 
 void main()
 {
-	FragColor = mix(texture(tex0, TexCoord), texture(tex1, TexCoord), 0.5);
+	FragColor = mix(texture(tex0, TexCoord), texture(tex1, TexCoord), mixAmount);
+	FragColor *= tint;
+#ifdef VERTEX_COLOR
+	FragColor.rgb *= VertexColor;
+#endif
 }
 
@@ -6,9 +6,11 @@ layout (location = 2) in vec2 tex;
 out vec3 VertexColor;
 out vec2 TexCoord;
 
+uniform vec2 offset;
+
 void main()
 {
-	gl_Position = vec4(pos.x, pos.y, pos.z, 1.0);
+	gl_Position = vec4(pos.xy + offset, pos.z, 1.0);
 	VertexColor = color;
 	TexCoord = tex;
 }
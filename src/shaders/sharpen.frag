@@ -0,0 +1,25 @@
+#version 330 core
+// Upscales source to the window bilinearly, then sharpens with an unsharp
+// mask over the four neighbouring source texels. The result is clamped to
+// the range of those texels, so edges do not ring.
+out vec4 FragColor;
+
+in vec2 TexCoord;
+
+uniform sampler2D source;
+uniform float sharpness;
+
+void main()
+{
+	vec2 texel = 1.0 / vec2(textureSize(source, 0));
+	vec3 c = texture(source, TexCoord).rgb;
+	vec3 n = texture(source, TexCoord + vec2(0.0, texel.y)).rgb;
+	vec3 s = texture(source, TexCoord - vec2(0.0, texel.y)).rgb;
+	vec3 e = texture(source, TexCoord + vec2(texel.x, 0.0)).rgb;
+	vec3 w = texture(source, TexCoord - vec2(texel.x, 0.0)).rgb;
+
+	vec3 lo = min(c, min(min(n, s), min(e, w)));
+	vec3 hi = max(c, max(max(n, s), max(e, w)));
+	vec3 sharpened = c + sharpness * (4.0 * c - n - s - e - w);
+	FragColor = vec4(clamp(sharpened, lo, hi), 1.0);
+}
@@ -0,0 +1,11 @@
+#pragma once
+// Krzysztof Narkowicz's fit of the ACES filmic curve, after exposure.
+
+uniform float tonemapExposure;
+
+vec4 tonemap(vec4 color)
+{
+	vec3 x = color.rgb * tonemapExposure;
+	x = (x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14);
+	return vec4(clamp(x, 0.0, 1.0), color.a);
+}
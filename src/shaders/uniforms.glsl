@@ -0,0 +1,15 @@
+#pragma once
+// Mirrors the structs in uniform_buffer.hpp
+
+layout (std140) uniform Frame
+{
+	vec2 resolution;
+	float time;
+	float deltaTime;
+};
+
+layout (std140) uniform Material
+{
+	vec4 tint;
+	float mixAmount;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// A fixed-size queue between exactly one producer thread and one consumer
+// thread. Neither side locks or waits: push() fails when the ring is full
+// and pop() when it is empty. Capacity must be a power of two.
+template <typename T, size_t Capacity> class SpscRing {
+  static_assert(Capacity && (Capacity & (Capacity - 1)) == 0,
+                "SpscRing capacity must be a power of two");
+
+public:
+  // producer
+  bool push(const T &value) {
+    size_t tail = this->tail.load(std::memory_order_relaxed);
+    if (tail - headCache == Capacity) {
+      headCache = head.load(std::memory_order_acquire);
+      if (tail - headCache == Capacity)
+        return false;
+    }
+    slots[tail & (Capacity - 1)] = value;
+    this->tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer
+  bool pop(T &value) {
+    size_t head = this->head.load(std::memory_order_relaxed);
+    if (head == tailCache) {
+      tailCache = tail.load(std::memory_order_acquire);
+      if (head == tailCache)
+        return false;
+    }
+    value = slots[head & (Capacity - 1)];
+    this->head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  T slots[Capacity];
+  // each index on its own cache line so the two sides do not contend; the
+  // caches save reloading the other side's index on every call
+  alignas(64) std::atomic<size_t> head{0};
+  size_t tailCache = 0; // consumer's copy of tail
+  alignas(64) std::atomic<size_t> tail{0};
+  size_t headCache = 0; // producer's copy of head
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+// The single place stb_image is compiled. Everything that decodes images
+// (image.hpp, jpeg_decoder.hpp) includes this rather than stb directly so the
+// allocator hooks are always in effect and stb's internals are visible.
+
+#include "decode_arena.hpp"
+
+// every stb allocation, including the returned pixels, comes from the arena
+#define STBI_MALLOC(sz) DecodeArena::local().allocate(sz)
+#define STBI_REALLOC(p, newsz) DecodeArena::local().reallocate(p, newsz)
+#define STBI_FREE(p) DecodeArena::free(p)
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb.h>
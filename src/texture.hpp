@@ -1,38 +1,166 @@
 #pragma once
 
 #include "debug.hpp"
+#include "gl_ext.hpp"
+#include "image.hpp"
+#include "sampler.hpp"
 #include <glad/glad.h>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb/stb.h>
+struct PixelFormat {
+  GLenum internal; // sized storage format
+  GLenum format;   // layout of the client data
+};
+
+// Pixel unpack buffer that textures are decoded into before the upload. One
+// is shared by all loads; it only grows, so steady-state loads reuse it.
+class UploadBuffer {
+public:
+  static UploadBuffer &instance() {
+    static UploadBuffer buffer;
+    return buffer;
+  }
+
+  // binds the buffer and maps the first bytes for writing, nullptr on failure
+  unsigned char *map(size_t bytes) {
+    if (!ID)
+      glGenBuffers(1, &ID);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ID);
+    if (bytes > capacity) {
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+      capacity = bytes;
+    }
+    // invalidating lets the driver hand out fresh memory instead of waiting
+    // for the previous upload to be consumed
+    return (unsigned char *)glMapBufferRange(
+        GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  }
+
+  // leaves the buffer bound so the following glTexSubImage2D sources from it
+  bool unmap() { return glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE; }
+  void unbind() { glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); }
+
+private:
+  unsigned int ID = 0;
+  size_t capacity = 0;
+};
 
 class Texture {
 public:
   unsigned int ID;
-  Texture(const char *path) {
+  unsigned int sampler;
+  int width = 0, height = 0, channels = 0;
+
+  // desiredChannels forces the decoder to expand/reduce to that many
+  // components, 0 keeps whatever the file decodes to
+  Texture(const char *path, const SamplerState &state = SamplerState(),
+          int desiredChannels = 0,
+          Orientation orientation = Orientation::Native) {
     glGenTextures(1, &ID);
     glBindTexture(GL_TEXTURE_2D, ID);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                    GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    int t_width, t_height, t_chan;
-    unsigned char *data = stbi_load(path, &t_width, &t_height, &t_chan, 0);
-    if (data) {
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, t_width, t_height, 0, GL_RGB,
-                   GL_UNSIGNED_BYTE, data);
+    // filtering and wrapping live on the shared sampler object
+    sampler = SamplerCache::instance().get(state);
+
+    std::vector<unsigned char> file;
+    ImageInfo info;
+    if (!read_file(path, file) || !image_info(file, desiredChannels, info)) {
+      DBG("ERROR::TEXTURE::FILE_NOT_SUCCESFULLY_READ " << path << ": "
+          << Image::failure());
+      return;
+    }
+    width = info.width;
+    height = info.height;
+    channels = info.channels;
+    PixelFormat fmt = pixelFormat(channels);
+
+    if (GLExt::textureStorage) {
+      // immutable storage is mip-complete up front, so the driver never
+      // has to re-validate the level chain at draw time
+      GLExt::TexStorage2D(GL_TEXTURE_2D, levels(width, height), fmt.internal,
+                          width, height);
+    } else {
+      glTexImage2D(GL_TEXTURE_2D, 0, fmt.internal, width, height, 0,
+                   fmt.format, GL_UNSIGNED_BYTE, nullptr);
+    }
+
+    // decode straight into the mapped unpack buffer, so the pixels are
+    // written once and the upload below is a GPU-side copy
+    DecodeArena &arena = DecodeArena::local();
+    arena.beginDecode();
+    UploadBuffer &upload = UploadBuffer::instance();
+    unsigned char *dst = upload.map(info.bytes());
+    bool decoded = dst && decode_into(file, info, dst, orientation);
+    size_t decodePeak = arena.endDecode();
+    // the buffer contents are undefined if unmapping fails
+    if (dst && !upload.unmap())
+      decoded = false;
+
+    if (decoded) {
+      // rows of e.g. a 3 channel odd-width image are not 4 byte aligned
+      glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment(width * channels));
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, fmt.format,
+                      GL_UNSIGNED_BYTE, nullptr);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+      swizzle(channels);
       glGenerateMipmap(GL_TEXTURE_2D);
+
+      DBG("TEXTURE::LOADED " << path << " " << width << "x" << height << "x"
+                             << channels << ", decode peak "
+                             << decodePeak / 1024 << " KiB");
     } else {
-      DBG("ERROR::TEXTURE::FILE_NOT_SUCCESFULLY_READ");
+      DBG("ERROR::TEXTURE::DECODE_FAILED " << path << ": "
+                                           << Image::failure());
     }
-    stbi_image_free(data);
+    upload.unbind();
   }
 
   void use(GLenum unit) {
     glActiveTexture(unit);
     glBindTexture(GL_TEXTURE_2D, ID);
+    glBindSampler(unit - GL_TEXTURE0, sampler);
+  }
+
+  // full mip chain down to 1x1
+  static int levels(int width, int height) {
+    int n = 1;
+    while ((width | height) >> n)
+      n++;
+    return n;
+  }
+
+  // store exactly what was decoded so the driver never converts on upload
+  static PixelFormat pixelFormat(int channels) {
+    switch (channels) {
+    case 1:
+      return {GL_R8, GL_RED};
+    case 2:
+      return {GL_RG8, GL_RG};
+    case 3:
+      return {GL_RGB8, GL_RGB};
+    default:
+      return {GL_RGBA8, GL_RGBA};
+    }
+  }
+
+  static int unpackAlignment(int rowBytes) {
+    if (rowBytes % 8 == 0)
+      return 8;
+    if (rowBytes % 4 == 0)
+      return 4;
+    if (rowBytes % 2 == 0)
+      return 2;
+    return 1;
+  }
+
+  // grey and grey+alpha images sample as rgb(a) like they did before
+  static void swizzle(int channels) {
+    if (channels == 1) {
+      GLint mask[] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+      glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, mask);
+    } else if (channels == 2) {
+      GLint mask[] = {GL_RED, GL_RED, GL_RED, GL_GREEN};
+      glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, mask);
+    }
   }
 };
@@ -0,0 +1,372 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "debug.hpp"
+#include "image.hpp"
+#include "sampler.hpp"
+#include "texture.hpp"
+
+// A texture whose finer mip levels are paged in and out by TextureStreamer.
+// Only [residentBase, levels) lives on the GPU, and sampling is clamped to
+// that range with BASE/MAX_LEVEL. The CPU keeps just the coarse levels that
+// were uploaded at load; finer ones are decoded from the file again when
+// they are wanted. Every level is uploaded from the shared UploadBuffer.
+class StreamedTexture {
+public:
+  unsigned int ID;
+  unsigned int sampler;
+  int width = 0, height = 0, channels = 0;
+  int levels = 0;
+  int residentBase = 0; // finest level currently uploaded
+  int wantedBase = 0;   // finest level worth having at the current size
+  float priority = 1.0f;
+
+  void use(GLenum unit) {
+    glActiveTexture(unit);
+    glBindTexture(GL_TEXTURE_2D, ID);
+    glBindSampler(unit - GL_TEXTURE0, sampler);
+  }
+
+  // pixels is the larger on-screen extent the texture is drawn at; levels
+  // finer than that would never be sampled
+  void request(int pixels, float prio = 1.0f) {
+    priority = prio;
+    wantedBase = 0;
+    while (wantedBase < levels - 1 &&
+           std::max(levelWidth(wantedBase + 1), levelHeight(wantedBase + 1)) >=
+               pixels)
+      wantedBase++;
+  }
+
+  int levelWidth(int level) const { return std::max(1, width >> level); }
+  int levelHeight(int level) const { return std::max(1, height >> level); }
+  size_t levelBytes(int level) const {
+    return (size_t)levelWidth(level) * levelHeight(level) * channels;
+  }
+
+private:
+  friend class TextureStreamer;
+  std::string path;
+  int cpuBase = 0; // finest level kept in mips
+  // finer than cpuBase only while decoded and waiting to be uploaded
+  std::vector<std::vector<unsigned char>> mips;
+
+  // pixels is an offset into the bound pixel unpack buffer
+  void upload(int level, const void *pixels) {
+    PixelFormat fmt = Texture::pixelFormat(channels);
+    glBindTexture(GL_TEXTURE_2D, ID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT,
+                  Texture::unpackAlignment(levelWidth(level) * channels));
+    glTexImage2D(GL_TEXTURE_2D, level, fmt.internal, levelWidth(level),
+                 levelHeight(level), 0, fmt.format, GL_UNSIGNED_BYTE,
+                 pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+    residentBase = level;
+  }
+
+  // clamp first so the level being dropped is never sampled, then
+  // respecify it as empty so the driver can release the memory
+  void evict() {
+    PixelFormat fmt = Texture::pixelFormat(channels);
+    glBindTexture(GL_TEXTURE_2D, ID);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, residentBase + 1);
+    glTexImage2D(GL_TEXTURE_2D, residentBase, fmt.internal, 0, 0, 0,
+                 fmt.format, GL_UNSIGNED_BYTE, nullptr);
+    residentBase++;
+  }
+};
+
+// Keeps streamed textures within a VRAM budget. New textures start with only
+// the mips up to lowSize resident, which are all the CPU keeps; update()
+// then refines the textures that want more detail, highest priority first,
+// decoding the file again for them, and sheds the finest levels of the
+// least important ones whenever the budget is exceeded.
+class TextureStreamer {
+public:
+  size_t budget;         // bytes of texture memory allowed
+  size_t resident = 0;   // bytes currently uploaded
+  int uploadsPerFrame;   // levels uploaded per update() to bound hitches
+  int lowSize;           // largest mip uploaded at load time
+
+  TextureStreamer(size_t budget, int uploadsPerFrame = 2, int lowSize = 64)
+      : budget(budget), uploadsPerFrame(uploadsPerFrame), lowSize(lowSize) {}
+
+  ~TextureStreamer() {
+    for (auto &t : textures)
+      glDeleteTextures(1, &t->ID);
+  }
+
+  StreamedTexture &load(const char *path,
+                        const SamplerState &state = SamplerState()) {
+    auto t = std::make_unique<StreamedTexture>();
+    t->path = path;
+    glGenTextures(1, &t->ID);
+    t->sampler = SamplerCache::instance().get(state);
+
+    Image image(path);
+    if (!image) {
+      DBG("ERROR::TEXTURE::FILE_NOT_SUCCESFULLY_READ " << path << ": "
+          << Image::failure());
+      textures.push_back(std::move(t));
+      return *textures.back();
+    }
+
+    t->width = image.width;
+    t->height = image.height;
+    t->channels = image.channels;
+    t->levels = Texture::levels(image.width, image.height);
+    t->cpuBase = t->levels - 1;
+    while (t->cpuBase > 0 && std::max(t->levelWidth(t->cpuBase - 1),
+                                      t->levelHeight(t->cpuBase - 1)) <=
+                                 lowSize)
+      t->cpuBase--;
+    t->mips = buildMips(*t, image.data, t->cpuBase);
+
+    glBindTexture(GL_TEXTURE_2D, t->ID);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, t->levels - 1);
+    Texture::swizzle(t->channels);
+
+    t->residentBase = t->levels;
+    if (uploadLevels(*t, t->cpuBase,
+                     [&](int level) { return t->mips[level].data(); }))
+      for (int level = t->cpuBase; level < t->levels; level++)
+        resident += t->levelBytes(level);
+    t->wantedBase = t->residentBase;
+
+    textures.push_back(std::move(t));
+    return *textures.back();
+  }
+
+  void update() {
+    // drop detail nobody asked for, decoded or uploaded, before touching
+    // anything else
+    for (auto &t : textures) {
+      while (t->residentBase < t->wantedBase)
+        evictOne(*t);
+      for (int level = 0; level < std::min(t->wantedBase, t->cpuBase); level++)
+        std::vector<unsigned char>().swap(t->mips[level]);
+    }
+
+    std::vector<StreamedTexture *> order;
+    for (auto &t : textures)
+      order.push_back(t.get());
+    std::sort(order.begin(), order.end(),
+              [](StreamedTexture *a, StreamedTexture *b) {
+                return a->priority > b->priority;
+              });
+
+    int uploads = 0;
+    for (StreamedTexture *t : order) {
+      if (uploads >= uploadsPerFrame || t->residentBase <= t->wantedBase)
+        continue;
+
+      // all the way to level 0 from a fresh decode: in one step, straight
+      // into the unpack buffer, the levels in between generated on the GPU
+      if (t->wantedBase == 0 && t->cpuBase > 0 && t->mips[0].empty()) {
+        size_t bytes = 0;
+        for (int level = 0; level < t->residentBase; level++)
+          bytes += t->levelBytes(level);
+        if (resident + bytes <= budget || makeRoom(bytes, t->priority)) {
+          if (decodeToTop(*t))
+            resident += bytes;
+          uploads++;
+          continue;
+        }
+      }
+
+      // otherwise as many levels as the budget and this frame's uploads
+      // allow
+      int target = t->residentBase;
+      size_t bytes = 0;
+      while (uploads < uploadsPerFrame && target > t->wantedBase) {
+        size_t level = t->levelBytes(target - 1);
+        if (resident + bytes + level > budget &&
+            !makeRoom(bytes + level, t->priority))
+          break;
+        bytes += level;
+        target--;
+        uploads++;
+      }
+      if (target < t->residentBase && refine(*t, target))
+        resident += bytes;
+    }
+  }
+
+private:
+  std::vector<std::unique_ptr<StreamedTexture>> textures;
+
+  void evictOne(StreamedTexture &t) {
+    resident -= t.levelBytes(t.residentBase);
+    t.evict();
+  }
+
+  // evicts finest levels from textures less important than prio until
+  // bytes more fit, lowest priority first
+  bool makeRoom(size_t bytes, float prio) {
+    while (resident + bytes > budget) {
+      StreamedTexture *victim = nullptr;
+      for (auto &t : textures) {
+        if (t->priority >= prio || t->residentBase >= t->levels - 1)
+          continue;
+        if (!victim || t->priority < victim->priority ||
+            (t->priority == victim->priority &&
+             t->residentBase < victim->residentBase))
+          victim = t.get();
+      }
+      if (!victim)
+        return false;
+      evictOne(*victim);
+    }
+    return true;
+  }
+
+  // Uploads the levels [target, residentBase). Those finer than the CPU
+  // keeps come from one decode of the file down to wantedBase, held until
+  // they are uploaded, so a refinement spread over frames decodes once.
+  bool refine(StreamedTexture &t, int target) {
+    for (int level = target; level < t.cpuBase; level++)
+      if (t.mips[level].empty()) {
+        if (!decode(t))
+          return false;
+        break;
+      }
+    if (!uploadLevels(t, target,
+                      [&](int level) { return t.mips[level].data(); }))
+      return false;
+    for (int level = target; level < t.cpuBase; level++)
+      std::vector<unsigned char>().swap(t.mips[level]);
+    return true;
+  }
+
+  static bool readFile(const StreamedTexture &t,
+                       std::vector<unsigned char> &file, ImageInfo &info) {
+    if (read_file(t.path.c_str(), file) &&
+        image_info(file, t.channels, info) && info.width == t.width &&
+        info.height == t.height)
+      return true;
+    DBG("ERROR::TEXTURE::STREAM_DECODE_FAILED " << t.path << ": "
+                                                << Image::failure());
+    return false;
+  }
+
+  // decodes the levels [wantedBase, residentBase) into mips
+  static bool decode(StreamedTexture &t) {
+    std::vector<unsigned char> file;
+    ImageInfo info;
+    if (!readFile(t, file, info))
+      return false;
+    std::vector<unsigned char> pixels(info.bytes());
+    DecodeArena &arena = DecodeArena::local();
+    arena.beginDecode();
+    bool decoded = decode_into(file, info, pixels.data());
+    arena.endDecode();
+    if (!decoded) {
+      DBG("ERROR::TEXTURE::STREAM_DECODE_FAILED " << t.path << ": "
+                                                  << Image::failure());
+      return false;
+    }
+    std::vector<std::vector<unsigned char>> levels =
+        buildMips(t, pixels.data(), t.wantedBase, t.residentBase);
+    for (int level = t.wantedBase; level < t.residentBase; level++)
+      t.mips[level] = std::move(levels[level]);
+    return true;
+  }
+
+  // decodes level 0 into the mapped unpack buffer and uploads it, then
+  // generates the levels down to the old base from it
+  static bool decodeToTop(StreamedTexture &t) {
+    std::vector<unsigned char> file;
+    ImageInfo info;
+    if (!readFile(t, file, info))
+      return false;
+    UploadBuffer &staging = UploadBuffer::instance();
+    DecodeArena &arena = DecodeArena::local();
+    arena.beginDecode();
+    unsigned char *dst = staging.map(info.bytes());
+    bool decoded = dst && decode_into(file, info, dst);
+    arena.endDecode();
+    // the buffer contents are undefined if unmapping fails
+    if (dst && !staging.unmap())
+      decoded = false;
+    if (decoded) {
+      t.upload(0, nullptr);
+      glGenerateMipmap(GL_TEXTURE_2D);
+    } else {
+      DBG("ERROR::TEXTURE::STREAM_DECODE_FAILED " << t.path << ": "
+                                                  << Image::failure());
+    }
+    staging.unbind();
+    return decoded;
+  }
+
+  // Copies the levels [first, residentBase) into the unpack buffer and
+  // uploads them from there, coarse first so the chain below the base is
+  // always complete. pixels(level) gives each level's data.
+  template <typename Pixels>
+  static bool uploadLevels(StreamedTexture &t, int first,
+                           const Pixels &pixels) {
+    std::vector<size_t> offsets(t.residentBase);
+    size_t size = 0;
+    for (int level = t.residentBase - 1; level >= first; level--) {
+      offsets[level] = size;
+      size += (t.levelBytes(level) + 7) & ~(size_t)7;
+    }
+
+    UploadBuffer &staging = UploadBuffer::instance();
+    unsigned char *dst = staging.map(size);
+    if (dst)
+      for (int level = first; level < t.residentBase; level++)
+        std::memcpy(dst + offsets[level], pixels(level), t.levelBytes(level));
+    bool ok = dst && staging.unmap();
+    if (ok)
+      for (int level = t.residentBase - 1; level >= first; level--)
+        t.upload(level, (const void *)offsets[level]);
+    staging.unbind();
+    return ok;
+  }
+
+  // The levels [keep, end) of the chain of pixels, the others left empty.
+  // 2x2 box filter down to 1x1; odd edges reuse the last row/column. A
+  // level is dropped once the next is built unless it is kept.
+  static std::vector<std::vector<unsigned char>>
+  buildMips(const StreamedTexture &t, const unsigned char *pixels, int keep,
+            int end = -1) {
+    const int c = t.channels;
+    if (end < 0)
+      end = t.levels;
+    std::vector<std::vector<unsigned char>> mips(t.levels);
+    if (keep == 0)
+      mips[0].assign(pixels, pixels + t.levelBytes(0));
+    const unsigned char *src = pixels;
+    for (int level = 1; level < end; level++) {
+      const int sw = t.levelWidth(level - 1), sh = t.levelHeight(level - 1);
+      const int dw = t.levelWidth(level), dh = t.levelHeight(level);
+      std::vector<unsigned char> &dst = mips[level];
+      dst.resize(t.levelBytes(level));
+      for (int y = 0; y < dh; y++) {
+        const int y0 = std::min(2 * y, sh - 1), y1 = std::min(2 * y + 1, sh - 1);
+        for (int x = 0; x < dw; x++) {
+          const int x0 = std::min(2 * x, sw - 1),
+                    x1 = std::min(2 * x + 1, sw - 1);
+          for (int k = 0; k < c; k++) {
+            int sum = src[(y0 * sw + x0) * c + k] + src[(y0 * sw + x1) * c + k] +
+                      src[(y1 * sw + x0) * c + k] + src[(y1 * sw + x1) * c + k];
+            dst[(y * dw + x) * c + k] = (unsigned char)((sum + 2) / 4);
+          }
+        }
+      }
+      if (level - 1 < keep)
+        std::vector<unsigned char>().swap(mips[level - 1]);
+      src = dst.data();
+    }
+    return mips;
+  }
+};
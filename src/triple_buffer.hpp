@@ -0,0 +1,35 @@
+#pragma once
+
+#include <atomic>
+
+// Hands the latest value from one producer thread to one consumer thread
+// without locks or waiting. Each side owns a slot and the third is swapped
+// between them through an atomic index, so the consumer always reads the
+// newest complete value, skipping any it was too slow for.
+template <typename T> class TripleBuffer {
+public:
+  // producer: fill this in completely, then publish() it
+  T &write() { return slots[back]; }
+  void publish() {
+    int previous = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+    back = previous & INDEX;
+  }
+
+  // consumer: picks up the newest published value, false if there is none
+  // since the last call; read() keeps returning the current one either way
+  bool acquire() {
+    if (!(middle.load(std::memory_order_relaxed) & FRESH))
+      return false;
+    int previous = middle.exchange(front, std::memory_order_acq_rel);
+    front = previous & INDEX;
+    return true;
+  }
+  const T &read() const { return slots[front]; }
+
+private:
+  static constexpr int INDEX = 3, FRESH = 4;
+
+  T slots[3];
+  int back = 0, front = 1;     // owned by producer and consumer
+  std::atomic<int> middle{2}; // slot index, FRESH once published
+};
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "debug.hpp"
+
+// Member types laid out the way std140 places them in a uniform block.
+// Scalars need nothing special. There is no vec3: GLSL packs a following
+// float into its last slot, which a C++ struct cannot express, so blocks
+// use vec4 instead.
+namespace std140 {
+struct alignas(8) vec2 {
+  float x, y;
+};
+struct alignas(16) vec4 {
+  float x, y, z, w;
+};
+struct alignas(16) mat4 {
+  vec4 columns[4];
+};
+} // namespace std140
+
+// fails the build if a member is not where std140 puts it in GLSL
+#define STD140_OFFSET(type, member, offset)                                    \
+  static_assert(offsetof(type, member) == (offset),                            \
+                #type "::" #member " is not at its std140 offset")
+
+// Fixed binding points; every program gets its blocks of these names bound
+// after linking (see Shader::finish), so nothing is looked up per draw.
+enum class UniformBinding : unsigned int {
+  Frame = 0,    // uniform Frame, once per frame
+  Material = 1, // uniform Material, per draw or material
+};
+
+inline void bindUniformBlocks(unsigned int program) {
+  static const struct {
+    const char *name;
+    UniformBinding binding;
+  } blocks[] = {{"Frame", UniformBinding::Frame},
+                {"Material", UniformBinding::Material}};
+
+  for (auto &block : blocks) {
+    unsigned int index = glGetUniformBlockIndex(program, block.name);
+    if (index != GL_INVALID_INDEX)
+      glUniformBlockBinding(program, index, (unsigned int)block.binding);
+  }
+}
+
+// Mirrors shaders/uniforms.glsl
+struct FrameUniforms {
+  std140::vec2 resolution; // framebuffer size in pixels
+  float time;              // seconds since start
+  float deltaTime;         // seconds since the previous frame
+};
+STD140_OFFSET(FrameUniforms, resolution, 0);
+STD140_OFFSET(FrameUniforms, time, 8);
+STD140_OFFSET(FrameUniforms, deltaTime, 12);
+
+struct MaterialUniforms {
+  std140::vec4 tint;
+  float mixAmount; // of the second texture over the first
+};
+STD140_OFFSET(MaterialUniforms, tint, 0);
+STD140_OFFSET(MaterialUniforms, mixAmount, 16);
+
+// where push() put a block inside the ring
+struct UniformSlot {
+  GLintptr offset = -1;
+  GLsizeiptr size = 0;
+
+  explicit operator bool() const { return offset >= 0; }
+};
+
+// One uniform buffer split into a region per frame in flight. Each frame
+// maps its region once, push() sub-allocates every block the frame's draws
+// need, and upload() unmaps it, so any number of draws share one buffer
+// update and only glBindBufferRange runs per draw. A fence per region keeps
+// the CPU from overwriting data the GPU has not read yet.
+class UniformRing {
+public:
+  UniformRing(size_t bytesPerFrame, int frames = 3)
+      : regionSize(bytesPerFrame), fences(frames, nullptr) {
+    int align = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+    alignment = (size_t)align;
+    regionSize = (regionSize + alignment - 1) / alignment * alignment;
+
+    glGenBuffers(1, &ID);
+    glBindBuffer(GL_UNIFORM_BUFFER, ID);
+    glBufferData(GL_UNIFORM_BUFFER, regionSize * frames, nullptr,
+                 GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+
+  // moves to the next region, waiting for the GPU if it still reads it
+  void beginFrame() {
+    region = (region + 1) % fences.size();
+    if (GLsync fence = fences[region]) {
+      while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                              1000000000) == GL_TIMEOUT_EXPIRED)
+        ;
+      glDeleteSync(fence);
+      fences[region] = nullptr;
+    }
+
+    used = 0;
+    glBindBuffer(GL_UNIFORM_BUFFER, ID);
+    // unsynchronized: the fence above already did the waiting
+    mapped = (unsigned char *)glMapBufferRange(
+        GL_UNIFORM_BUFFER, region * regionSize, regionSize,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+            GL_MAP_UNSYNCHRONIZED_BIT);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    if (!mapped)
+      DBG("ERROR::UNIFORM_RING::MAP_FAILED");
+  }
+
+  // copies a block into this frame's region; the slot is invalid if the
+  // region is full
+  template <typename T> UniformSlot push(const T &block) {
+    static_assert(alignof(T) <= 16, "uniform blocks align to at most 16");
+    UniformSlot slot;
+    if (!mapped || used + sizeof(T) > regionSize) {
+      DBG("ERROR::UNIFORM_RING::FULL " << regionSize << " bytes per frame");
+      return slot;
+    }
+    std::memcpy(mapped + used, &block, sizeof(T));
+    slot.offset = (GLintptr)(region * regionSize + used);
+    slot.size = sizeof(T);
+    used = (used + sizeof(T) + alignment - 1) / alignment * alignment;
+    return slot;
+  }
+
+  // call after the last push() and before the first draw using the slots
+  void upload() {
+    if (!mapped)
+      return;
+    glBindBuffer(GL_UNIFORM_BUFFER, ID);
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    mapped = nullptr;
+  }
+
+  void bind(UniformBinding binding, const UniformSlot &slot) const {
+    if (slot)
+      glBindBufferRange(GL_UNIFORM_BUFFER, (unsigned int)binding, ID,
+                        slot.offset, slot.size);
+  }
+
+  // call once the frame's draws are issued
+  void endFrame() {
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+private:
+  unsigned int ID = 0;
+  size_t regionSize, alignment = 256, used = 0, region = 0;
+  std::vector<GLsync> fences;
+  unsigned char *mapped = nullptr;
+};